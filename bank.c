@@ -1,14 +1,98 @@
 
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdio_ext.h>
+#include <sched.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// USDT probes for perf/bpftrace. With sys/sdt.h each probe is a single nop
+// until a tracer attaches; without it (or with -DBANK_NO_USDT) they vanish.
+// Amounts are passed in cents so tracers need no floating-point support.
+//   bank:login__entry()                       bank:login__return(index, result)
+//   bank:deposit__entry(index, cents)         bank:deposit__return(index, cents, result)
+//   bank:withdraw__entry(index, cents)        bank:withdraw__return(index, cents, result)
+//   bank:purchase__entry(index, balance)      bank:purchase__return(index, balanceChange)
+//   bank:loan__entry(index, loan)             bank:loan__return(index, loanChange)
+//   bank:interest__entry(index, balance)      bank:interest__return(index, balanceChange)
+//   bank:forex__entry(index, balance)         bank:forex__return(index, balanceChange)
+//   bank:save__entry(accounts)                bank:save__return(accounts, result)
+//   bank:load__entry()                        bank:load__return(accounts, result)
+//   bank:request__entry(op, index, cents)     bank:request__return(op, index, result)
+#if !defined(BANK_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define BANK_USDT 1
+#endif
+#endif
+
+#ifdef BANK_USDT
+#define PROBE0(name) DTRACE_PROBE(bank, name)
+#define PROBE1(name, a) DTRACE_PROBE1(bank, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(bank, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(bank, name, a, b, c)
+#else
+#define PROBE0(name) ((void)0)
+#define PROBE1(name, a) ((void)(a))
+#define PROBE2(name, a, b) ((void)(a), (void)(b))
+#define PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#endif
+
+#define CENTS(amount) ((long long)llround((double)(amount) * 100.0))
+
+// Span tracing for --trace; each macro is one predictable branch when off.
+// TRACE_SCOPE closes its span on every return from the enclosing block.
+#define TRACE_BEGIN(name) do { if (traceFilePath != NULL) traceRecord(name, 'B'); } while (0)
+#define TRACE_END(name) do { if (traceFilePath != NULL) traceRecord(name, 'E'); } while (0)
+#define TRACE_SCOPE(name) \
+    const char *traceScope __attribute__((cleanup(traceScopeEnd), unused)) = traceScopeBegin(name)
+
+// Allocation accounting for -DBANK_ALLOC_TRACKING builds; both scopes
+// restore the enclosing subsystem or operation when the block exits.
+#ifdef BANK_ALLOC_TRACKING
+#define ALLOC_SCOPE(subsystem) \
+    int allocScope __attribute__((cleanup(allocScopeEnd), unused)) = allocScopeBegin(subsystem)
+#define ALLOC_OPERATION(op) \
+    int allocOperationScope __attribute__((cleanup(allocOperationEnd), unused)) = allocOperationBegin(op)
+#else
+#define ALLOC_SCOPE(subsystem) ((void)0)
+#define ALLOC_OPERATION(op) ((void)0)
+#endif
+
+// Structured logging for --log; the caller only fills a fixed-size record
+// and the writer thread formats it later. Amounts are passed in cents.
+#define LOG_EVENT(id, a, b, c, value) \
+    do { if (logFilePath != NULL) logRecord(id, a, b, c, value); } while (0)
 
 // ==================== CONSTANTS ====================
-#define MAX_ACCOUNTS 100
+#define MAX_ACCOUNTS 16777216           // Hard cap; the table grows on demand
+#define INITIAL_ACCOUNT_CAPACITY 128
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define HUGE_PAGE_MIN_BYTES (HUGE_PAGE_SIZE / 2)   // Smaller tables stay on the heap
 #define MAX_NAME_LENGTH 50
 #define MIN_PIN 1000
 #define MAX_PIN 9999
@@ -16,20 +100,154 @@
 #define STARTING_BALANCE 1000.0f
 #define LOAN_AMOUNT 500.0f
 #define ASSET_PURCHASE_AMOUNT 100.0f
+#define MAX_INSTRUMENTS 256
+#define INSTRUMENT_CODE_LENGTH 8
+#define INSTRUMENT_NAME_LENGTH 24
+#define MAX_CURRENCIES 256
+#define BASE_CURRENCY 0
+#define BASE_CURRENCY_CODE "USD"
+#define MAX_DIRECT_QUOTES 4096
+#define MAX_ARBITRAGE_ROUNDS 32
+#define ARBITRAGE_TOLERANCE 1e-6
+#define QUOTES_FILE "fx_quotes.txt"
+#define JOURNAL_FILE "journal.dat"
+#define CHECKPOINT_FILE "checkpoints.dat"
+#define JOURNAL_INDEX_FILE "journal.idx"
+#define CHECKPOINT_INTERVAL 1000
+#define TRACE_BUFFER_EVENTS 65536            // Per thread; later spans are dropped
+#define LOG_RING_RECORDS 4096                // Per thread (power of two); overflow is dropped
+#define LOG_FLUSH_MICROS 10000               // Writer idle poll
+#define ALLOC_CHECK_ACCOUNTS 10000
+#define ALLOC_CHECK_DEFAULT_OPERATIONS 100000   // Measured per operation, after as many warm-up runs
+#define ALLOC_CHECK_SAVES 20
+#define METRIC_SHARDS 64                     // Per-CPU counter shards (power of two)
+#define METRIC_STATUSES (ERROR_BUSY + 1)     // One counter per ErrorCode
+#define SAVE_LATENCY_BUCKETS 12
+#define METRICS_FILE_INTERVAL_MICROS 1000000
+#define METRICS_STOP_CHECK_MICROS 100000       // Longest the exporter takes to notice shutdown
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+#define METRICS_LISTEN_BACKLOG 16
+#define HISTORY_PAGE_SIZE 10
+#define POSTINGS_FILE "postings.dat"
+#define MAX_EVENT_POSTINGS 8
+#define RECONCILE_TOLERANCE 0.01
+#define FOLLOWER_POLL_MICROS 1000
+#define FOLLOWER_READ_BATCH 256
+#define FOLLOWER_RESYNC_POLLS 100
+#define SHARED_STORE_NAME "/bank_accounts"
+#define SHARED_STORE_MAGIC 0x42414e4bu
+#define SHARED_STORE_CAPACITY 65536      // Accounts a shared region is sized for
+#define SHARED_STORE_WAIT_MICROS 5000000L
+#define RING_REGION_NAME "/bank_rings"
+#define RING_REGION_MAGIC 0x52494e47u
+#define RING_CAPACITY 1024
+#define CLIENT_BATCH_LIMIT 100000
+#define CLIENT_RATE_PER_SECOND 200000.0     // Token-bucket refill rate per client
+#define CLIENT_BURST 2048.0                 // Token-bucket depth per client
+#define GLOBAL_QUEUE_LIMIT 4096             // Queued requests across all clients before shedding
+#define BATCH_SLICE_MICROS 2000            // Batch work per pass once interactive rings are drained
+#define PREEMPT_CHECK_INTERVAL 64           // Batch items between checks for interactive arrivals
+#define GENERATED_LOAN_SHARE 0.15         // Fraction of generated accounts holding a loan
+#define GENERATED_ASSET_SHARE 0.25        // Chance a generated account holds each asset
+#define GENERATED_WALLET_SHARE 0.10       // Chance it holds each foreign currency
+#define DEFAULT_WORKLOAD_MIX "deposit=50,withdraw=30,purchase=10,status=10"
+#define DEFAULT_WORKLOAD_SKEW 0.99        // Zipf exponent; 0 spreads load evenly
+#define DEFAULT_LOAD_MIX "login=5,deposit=35,withdraw=25,purchase=10,loan=5,fx=10,status=10"
+#define LATENCY_SUB_BUCKETS 16              // Linear steps within each power of two
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+#define BENCH_DEFAULT_MAX_ACCOUNTS 1000000
+#define BENCH_MIN_OPERATIONS 200000         // Per measurement, so short paths run long enough to time
+#define BENCH_SNAPSHOT_FILE "bench_snapshot.dat"
+#define DEDUPE_CAPACITY 65536                 // Remembered transactions (power of two)
+#define DEDUPE_WINDOW_MICROS 600000000LL      // Retries accepted for ten minutes
+#define MAX_RING_CLIENTS 16
+#define RING_SPIN_ITERATIONS 20000
+#define RING_SLEEP_MICROS 100000L
+#define MAX_RECONCILE_THREADS 64
+#define RECONCILE_MEMORY_BUDGET (1LL << 30)      // Bytes of per-thread partial sums, all threads together
 #define DATA_FILE "accounts.dat"
+#define SNAPSHOT_MAGIC 0x534e4150u                // "SNAP"
+#define SNAPSHOT_VERSION 2                        // 2 added the state root
+#define SNAPSHOT_SEQUENCE_UNKNOWN ULLONG_MAX      // Snapshot predates the header
+#define LEGACY_REGISTRY_ACCOUNT_SIZE 64           // Registry-era Account before lastEventOffset
 
 // ==================== ENUMERATIONS ====================
 typedef enum {
-    CRYPTO = 0,
-    GOLD,
-    SILVER
-} AssetType;
+    INSTRUMENT_ASSET = 0,
+    INSTRUMENT_CURRENCY,
+    INSTRUMENT_KIND_COUNT
+} InstrumentKind;
+
+typedef enum {
+    OP_LOGIN = 1,
+    OP_DEPOSIT,
+    OP_WITHDRAW,
+    OP_STATUS,
+    OP_PURCHASE,
+    OP_LOAN,
+    OP_CONVERT,
+    OP_INTEREST
+} RequestOp;
+
+typedef enum {
+    CHANNEL_FREE = 0,
+    CHANNEL_CLAIMING,   // Being reset by a connecting client; ignored by the daemon
+    CHANNEL_CLAIMED
+} ChannelState;
+
+typedef enum {
+    BENCH_LOGIN_LOOKUP = 0,
+    BENCH_ACCOUNT_EXISTS,
+    BENCH_DEPOSIT,
+    BENCH_SAVE,
+    BENCH_INTEREST_BATCH,
+    BENCH_REVALUATION,
+    BENCH_PATH_COUNT
+} BenchPath;
+
+typedef enum {
+    PRIORITY_INTERACTIVE = 0,   // Served first and in full every pass
+    PRIORITY_BATCH              // Time-sliced and preempted by interactive arrivals
+} PriorityClass;
+
+typedef enum {
+    PAGES_HEAP = 0,             // malloc/realloc
+    PAGES_MAPPED,               // Anonymous mapping on regular pages
+    PAGES_TRANSPARENT,          // Anonymous mapping advised for transparent huge pages
+    PAGES_EXPLICIT              // MAP_HUGETLB mapping from the reserved pool
+} PageBacking;
+
+typedef enum {
+    ALLOC_OTHER = 0,
+    ALLOC_ACCOUNT_TABLE,        // Accounts, holdings columns and the hash tree
+    ALLOC_NAME_INDEX,
+    ALLOC_JOURNAL,              // Journal, postings, checkpoints and replay
+    ALLOC_PERSISTENCE,          // Account file load and save
+    ALLOC_REQUEST_ENGINE,       // Dedupe window and daemon transport
+    ALLOC_FOREX,
+    ALLOC_DIAGNOSTICS,          // Tracing, logging and metrics
+    ALLOC_WORKLOAD,             // Generators, load tests and benchmarks
+    ALLOC_SUBSYSTEM_COUNT
+} AllocSubsystem;
+
+typedef enum {
+    LOG_EVENT_COMMITTED = 1,    // event type, account, status; value = amount in cents
+    LOG_REQUEST_REFUSED,        // op, account, client pid
+    LOG_QUEUE_SHEDDING,         // queue depth, clients, fair share
+    LOG_SAVE,                   // accounts, status; value = microseconds
+    LOG_CLIENT_REAPED           // channel slot, pid
+} LogEventId;
 
 typedef enum {
-    EUR = 0,
-    GBP,
-    INR
-} CurrencyType;
+    EVENT_ACCOUNT_CREATED = 1,
+    EVENT_DEPOSIT,
+    EVENT_WITHDRAWAL,
+    EVENT_ASSET_PURCHASE,
+    EVENT_LOAN_TAKEN,
+    EVENT_LOAN_REPAID,
+    EVENT_INTEREST,
+    EVENT_CURRENCY_CONVERSION
+} EventType;
 
 typedef enum {
     SUCCESS = 0,
@@ -37,7 +255,9 @@ typedef enum {
     ERROR_INVALID_PIN,
     ERROR_ACCOUNT_EXISTS,
     ERROR_FILE_IO,
-    ERROR_INVALID_INPUT
+    ERROR_INVALID_INPUT,
+    ERROR_RATE_BLOCKED,
+    ERROR_BUSY
 } ErrorCode;
 
 // ==================== STRUCTURES ====================
@@ -46,706 +266,6351 @@ typedef struct {
     int pin;
     float balance;
     float loan;
-    
-    // Asset holdings
-    struct {
-        float crypto;
-        float gold;
-        float silver;
-    } assets;
-    
-    // Foreign currency holdings
-    struct {
-        float eur;
-        float gbp;
-        float inr;
-    } currencies;
+    long lastEventOffset;   // Journal offset of this account's newest event (-1 if none)
 } Account;
 
+/**
+ * Account record of the original fixed-field layout (before the
+ * instrument registry), kept to migrate old data files
+ */
 typedef struct {
-    float crypto;
-    float gold;
-    float silver;
-} MarketPrices;
+    char name[MAX_NAME_LENGTH];
+    int pin;
+    float balance;
+    float loan;
+    float holdings[6];             // CRYPTO, GOLD, SILVER, then EUR, GBP, INR
+} LegacyAccount;
 
+/**
+ * Leading block of every snapshot (data file and checkpoints)
+ */
 typedef struct {
-    float eur;
-    float gbp;
-    float inr;
-} ExchangeRates;
+    unsigned int magic;            // SNAPSHOT_MAGIC
+    unsigned int version;          // SNAPSHOT_VERSION
+    unsigned int accountSize;      // sizeof(Account) of the writer
+    int accountCount;
+    unsigned long long journalSequence; // Journal events reflected in the state
+    int merkleLeaves;              // Shape of the tree stateRoot came from, 0 if unknown (version 1)
+    unsigned long long stateRoot;  // Hash tree root over the accounts written
+} SnapshotHeader;
 
-// ==================== GLOBAL STATE ====================
-static Account accounts[MAX_ACCOUNTS];
-static int accountCount = 0;
-static int currentUserIndex = -1;
+/**
+ * Journaled operation. Events record the resulting deltas rather than the
+ * inputs, so replay never depends on prices or exchange rates.
+ */
+typedef struct {
+    unsigned long long sequence;   // Position in the journal (0-based)
+    long long timestamp;           // Microseconds since the epoch
+    int type;                      // EventType
+    int accountIndex;
+    float amount;                  // Operation amount as entered
+    float balanceDelta;
+    float loanDelta;
+    int instrument;                // First instrument leg (-1 if none)
+    float instrumentDelta;
+    int counterInstrument;         // Second instrument leg (-1 if none)
+    float counterDelta;
+    char name[MAX_NAME_LENGTH];    // Account creation only
+    int pin;                       // Account creation only
+    long previousOffset;           // Same account's previous event (-1 if first)
+} Event;
 
-static MarketPrices marketPrices = {150.0f, 60.0f, 25.0f};
-static ExchangeRates exchangeRates = {1.10f, 1.27f, 0.012f};
+/**
+ * General-ledger accounts. Customer ledgers are per account and per unit;
+ * bank-side ledgers absorb the other half of every operation.
+ */
+typedef enum {
+    LEDGER_CUSTOMER_WALLET = 0,  // Customer cash or instrument holdings (liability)
+    LEDGER_CUSTOMER_LOAN,        // Customer loan principal (asset)
+    LEDGER_CASH_VAULT,           // Cash paid in and out over the counter
+    LEDGER_TRADING,              // Bank's side of asset purchases and conversions
+    LEDGER_INTEREST_EXPENSE,     // Interest credited to customers
+    LEDGER_EQUITY                // Opening balances and account-opening grants
+} LedgerAccount;
 
-// ==================== UTILITY FUNCTIONS ====================
+/**
+ * One side of a double-entry posting. Debits are positive, credits negative;
+ * the postings of each event sum to zero per unit (USD or instrument).
+ */
+typedef struct {
+    unsigned long long eventSequence;
+    int ledger;                    // LedgerAccount
+    int accountIndex;              // Customer account, -1 for bank ledgers
+    int instrument;                // -1 for USD cash
+    double amount;
+} Posting;
 
 /**
- * Clear input buffer to prevent scanf issues
+ * Binary hash tree over account slots in heap layout: the root is node 1 and
+ * leaf i is node leafCount + i. Hashes are 64-bit FNV-1a, which detects
+ * divergence between copies but is not tamper-proof.
  */
-void clearInputBuffer(void) {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
-}
+typedef struct {
+    int leafCount;                 // Power of two
+    unsigned long long *nodes;     // 2 * leafCount entries, node 0 unused
+} MerkleTree;
 
 /**
- * Validate if string contains only alphabetic characters
+ * Header of the shared account region. It is followed by the account
+ * table, the holdings columns and the hash tree nodes. Every mutation runs
+ * under the robust process-shared lock, and the count and journal position
+ * are published back here before it is released.
  */
-bool isAlphaString(const char *str) {
-    if (str == NULL || *str == '\0') return false;
-    
-    for (int i = 0; str[i] != '\0'; i++) {
-        if (!isalpha((unsigned char)str[i])) {
-            return false;
-        }
-    }
-    return true;
-}
+typedef struct {
+    unsigned int magic;            // Set once the creator has loaded state
+    int capacity;
+    int instrumentCount;
+    int merkleLeaves;
+    pthread_mutex_t lock;
+    int accountCount;
+    unsigned long long journalSequence;
+    long postingsLength;           // Bytes of postings published with that sequence (0 if unknown)
+} SharedStoreHeader;
 
 /**
- * Validate PIN is within valid range
+ * Operation request sent to the daemon. Every operation except login is
+ * authenticated by the account index and PIN returned at login.
  */
-bool isValidPIN(int pin) {
-    return (pin >= MIN_PIN && pin <= MAX_PIN);
-}
+typedef struct {
+    unsigned long long requestId;  // Echoed in the response
+    unsigned long long transactionId; // Client-chosen identity for retries (0 = none)
+    int op;                        // RequestOp
+    int accountIndex;
+    int pin;
+    int instrument;                // Asset to buy, or source currency slot
+    int counterInstrument;         // Target currency slot
+    float amount;
+    char name[MAX_NAME_LENGTH];    // Login only
+} Request;
 
 /**
- * Safe float input with validation
+ * Result of one request
  */
-bool getFloatInput(const char *prompt, float *value) {
-    printf("%s", prompt);
-    if (scanf("%f", value) != 1) {
-        clearInputBuffer();
-        return false;
-    }
-    clearInputBuffer();
-    return true;
-}
+typedef struct {
+    unsigned long long requestId;
+    int status;                    // ErrorCode
+    int accountIndex;
+    float balance;
+    float loan;
+    float value;                   // Units bought, amount received or holdings value
+} Response;
 
 /**
- * Safe integer input with validation
+ * Remembered outcome of a transaction, kept in arrival order
  */
-bool getIntInput(const char *prompt, int *value) {
-    printf("%s", prompt);
-    if (scanf("%d", value) != 1) {
-        clearInputBuffer();
-        return false;
-    }
-    clearInputBuffer();
-    return true;
-}
+typedef struct {
+    unsigned long long transactionId;
+    int accountIndex;
+    long long timestamp;           // Microseconds when first executed
+    Response response;
+} DedupeEntry;
 
 /**
- * Display error message based on error code
+ * Recently executed transactions. The hash index maps into a FIFO of
+ * entries so the oldest can be evicted when the window slides or fills.
  */
-void displayError(ErrorCode error) {
-    switch (error) {
-        case ERROR_INSUFFICIENT_FUNDS:
-            printf("\n[ERROR] Insufficient funds for this transaction.\n");
-            break;
-        case ERROR_INVALID_PIN:
-            printf("\n[ERROR] Invalid PIN entered.\n");
-            break;
-        case ERROR_ACCOUNT_EXISTS:
-            printf("\n[ERROR] Account with this name or PIN already exists.\n");
-            break;
-        case ERROR_FILE_IO:
-            printf("\n[ERROR] File operation failed.\n");
-            break;
-        case ERROR_INVALID_INPUT:
-            printf("\n[ERROR] Invalid input provided.\n");
-            break;
-        default:
-            printf("\n[ERROR] An unknown error occurred.\n");
-    }
-}
+typedef struct {
+    DedupeEntry entries[DEDUPE_CAPACITY];      // FIFO, oldest at `oldest`
+    int index[DEDUPE_CAPACITY * 2];            // Open addressing, -1 = empty
+    unsigned int oldest;
+    unsigned int count;
+    unsigned long long replays;
+} DedupeWindow;
 
-// ==================== FILE OPERATIONS ====================
+/**
+ * Zipf-distributed account picker: cumulative weights by popularity rank
+ * and a shuffled mapping from rank to account slot
+ */
+typedef struct {
+    double *cdf;
+    int *slotOfRank;
+    int count;
+} ZipfSampler;
 
 /**
- * Save all accounts to persistent storage
+ * Log-linear latency histogram in nanoseconds. Buckets are atomic so a
+ * reporter can drain a client's interval counts while it keeps recording.
  */
-ErrorCode saveAccounts(void) {
-    FILE *file = fopen(DATA_FILE, "wb");
-    if (file == NULL) {
-        return ERROR_FILE_IO;
-    }
-    
-    // Write account count
-    if (fwrite(&accountCount, sizeof(int), 1, file) != 1) {
-        fclose(file);
-        return ERROR_FILE_IO;
+typedef struct {
+    atomic_ullong buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/**
+ * Single-producer/single-consumer ring positions. Indices grow without
+ * bound and are masked on access; each lives on its own cache line.
+ */
+typedef struct {
+    _Alignas(64) atomic_uint head;      // Next slot the producer fills
+    _Alignas(64) atomic_uint tail;      // Next slot the consumer drains
+    _Alignas(64) atomic_uint sleeping;  // Futex word: consumer parked waiting for data
+} RingControl;
+
+/**
+ * One client's request and response rings
+ */
+typedef struct {
+    _Alignas(64) atomic_int state;      // ChannelState
+    pid_t pid;
+    int priority;                       // PriorityClass
+    double tokens;                      // Admission budget, refilled by the daemon
+    long long lastRefill;               // Microseconds; 0 until the daemon first sees the client
+    atomic_ullong admitted;
+    atomic_ullong rejected;             // Answered ERROR_BUSY
+    atomic_uint maxDepth;               // Deepest request queue observed
+    RingControl requests;
+    RingControl responses;
+    Request requestSlots[RING_CAPACITY];
+    Response responseSlots[RING_CAPACITY];
+} ClientChannel;
+
+/**
+ * Shared region between the daemon and its clients. The daemon drains all
+ * request rings and parks on the doorbell only after they all go idle.
+ */
+typedef struct {
+    atomic_uint magic;                  // RING_REGION_MAGIC while a daemon serves the region
+    pid_t daemonPid;                    // Lets parked clients notice a daemon that died
+    atomic_uint queueDepth;             // Requests queued across all clients at the last pass
+    atomic_ullong shedPasses;           // Passes that found the global queue over its limit
+    _Alignas(64) atomic_uint doorbell;  // Futex word: daemon parked waiting for requests
+    ClientChannel channels[MAX_RING_CLIENTS];
+} RingRegion;
+
+/**
+ * One benchmark worker's share of a measurement
+ */
+typedef struct {
+    pthread_t thread;
+    int path;                      // BenchPath
+    int first;                     // Slice of operations or accounts this worker covers
+    int last;
+    unsigned long long seed;
+    double checksum;               // Keeps read-only loops from being optimised away
+} BenchWorker;
+
+/**
+ * One simulated load-test client
+ */
+typedef struct {
+    pthread_t thread;
+    int id;
+    ClientChannel *channel;        // NULL when driving the in-process engine
+    unsigned long long seed;
+    double intervalNanos;          // Pacing between requests (0 = closed loop, no pause)
+    LatencyHistogram interval;     // Drained by the reporter every second
+    atomic_ullong busy;
+    atomic_ullong failed;          // Rejected for any other reason
+} LoadClient;
+
+/**
+ * One begin or end mark of a traced span
+ */
+typedef struct {
+    const char *name;              // String literal naming the span
+    long long timestamp;           // Monotonic microseconds
+    char phase;                    // 'B' or 'E'
+} TraceEvent;
+
+/**
+ * Per-thread trace buffer. Only its owner appends; buffers are linked
+ * into a global list once, with a compare-and-swap, for export.
+ */
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    int tid;
+    atomic_int count;
+    unsigned long dropped;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+/**
+ * Memory held by one subsystem: bytes allocated or mapped, and the part
+ * of them holding live data
+ */
+typedef struct {
+    size_t reserved;
+    size_t used;
+} MemoryUsage;
+
+/**
+ * Allocator calls charged to one subsystem or operation
+ */
+typedef struct {
+    atomic_ullong allocations;     // malloc, calloc and realloc calls
+    atomic_ullong frees;
+    atomic_ullong bytes;           // Requested, not necessarily still held
+} AllocCounters;
+
+/**
+ * Fixed-size log record; its meaning depends on the LogEventId
+ */
+typedef struct {
+    long long timestamp;           // Microseconds since the epoch
+    int id;                        // LogEventId
+    int args[3];
+    long long value;
+} LogRecord;
+
+/**
+ * Per-thread log ring. The owner produces and the writer thread consumes;
+ * rings are linked into a global list once, with a compare-and-swap.
+ */
+typedef struct LogRing {
+    struct LogRing *next;
+    int tid;
+    _Alignas(64) atomic_uint head;      // Next slot the owner fills
+    _Alignas(64) atomic_uint tail;      // Next slot the writer formats
+    atomic_ulong dropped;               // Records lost to a full ring since the last drain
+    LogRecord records[LOG_RING_RECORDS];
+} LogRing;
+
+/**
+ * One CPU's share of the metric counters, aligned so no two shards share
+ * a cache line. Request and event counters are indexed by op or type and
+ * ErrorCode; save latencies go into fixed buckets plus an overflow bucket.
+ */
+typedef struct {
+    _Alignas(64) atomic_ullong requests[OP_INTEREST + 1][METRIC_STATUSES];
+    atomic_ullong events[EVENT_CURRENCY_CONVERSION + 1][METRIC_STATUSES];
+    atomic_ullong saveBuckets[SAVE_LATENCY_BUCKETS + 1];
+    atomic_ullong saveMicros;
+} MetricShard;
+
+/**
+ * Journal index entry locating a checkpoint and the first event after it
+ */
+typedef struct {
+    unsigned long long sequence;   // Events applied when the checkpoint was taken
+    long long timestamp;
+    long journalOffset;
+    long checkpointOffset;
+} JournalIndexEntry;
+
+/**
+ * Tradable instrument (asset or foreign currency). Prices and holdings
+ * live in separate per-instrument arrays indexed by the instrument id.
+ */
+typedef struct {
+    char code[INSTRUMENT_CODE_LENGTH];
+    char name[INSTRUMENT_NAME_LENGTH];
+    InstrumentKind kind;
+    int minChangePct;   // Lower bound of a market update move
+    int changeSpanPct;  // Width of the move range (0 = fixed price)
+} Instrument;
+
+/**
+ * Cached conversion rate (units of the target per unit of the source)
+ */
+typedef struct {
+    float rate;
+    unsigned int fromEpoch;
+    unsigned int toEpoch;
+} CrossRate;
+
+/**
+ * Directly quoted conversion rate overriding the USD triangulation
+ */
+typedef struct {
+    int from;
+    int to;
+    float rate;
+} DirectQuote;
+
+/**
+ * One conversion order in an FX batch
+ */
+typedef struct {
+    int accountIndex;
+    int from;
+    int to;
+    float amount;
+} FxOrder;
+
+/**
+ * Per-order outcome of an FX batch
+ */
+typedef struct {
+    ErrorCode status;
+    float received;
+} FxResult;
+
+/**
+ * Netted position for one currency pair within a batch, in units of the
+ * lower slot. Rates are snapshotted when the pair is first seen.
+ */
+typedef struct {
+    int low;
+    int high;
+    float lowToHigh;
+    float highToLow;
+    double gross;
+    double net;
+} FxNetPosition;
+
+/**
+ * Totals for an FX batch
+ */
+typedef struct {
+    int executed;
+    int rejected;
+    int pairs;
+    double grossUsd;               // Executed volume, all orders
+    double netUsd;                 // Left after offsetting orders per pair; reported, not booked
+} FxBatchSummary;
+
+/**
+ * Outcome of one arbitrage check over the rate graph
+ */
+typedef struct {
+    int cyclesFound;
+    int pairsBlocked;
+    long elapsedMicros;
+} ArbitrageReport;
+
+// ==================== GLOBAL STATE ====================
+static Account *accounts = NULL;    // Points into shared memory in shared mode
+static int accountCount = 0;
+static int accountCapacity = 0;     // Slots allocated in accounts and each holdings column
+static int currentUserIndex = -1;
+
+// Append-only event journal and its double-entry postings
+static FILE *journalFile = NULL;
+static unsigned long long journalSequence = 0;
+static unsigned long long snapshotSequence = 0;    // Journal position of the last snapshot read
+static FILE *postingsFile = NULL;
+
+// Account file and checkpoint log, opened on first use and kept open so
+// saves and checkpoints reuse their streams instead of allocating new ones
+static FILE *dataFile = NULL;
+static FILE *checkpointFile = NULL;
+static FILE *checkpointIndexFile = NULL;
+
+// Hash tree over account state, updated on every applied event
+static MerkleTree stateTree;
+
+// Shared account region (NULL when this process owns its state alone)
+static SharedStoreHeader *sharedStore = NULL;
+
+// Rebuilds shared state after a process died holding the store lock. It
+// needs the journal code defined further down, so main() installs it.
+static bool (*sharedStoreRecovery)(void) = NULL;
+
+static Instrument instruments[MAX_INSTRUMENTS];
+static int instrumentCount = 0;
+
+// USD value of one unit of each instrument (asset price or exchange rate)
+static float instrumentPrices[MAX_INSTRUMENTS];
+
+// Holdings per instrument, each column contiguous across accounts
+static float *holdings[MAX_INSTRUMENTS];
+
+// Hash index from holder name to account slot, plus PINs in use. Both
+// catch up lazily with accounts appended since the last lookup.
+static int *nameIndex = NULL;       // Open addressing, -1 = empty
+static int nameIndexSize = 0;       // Power of two, at least twice the indexed count
+static int indexedCount = 0;
+static unsigned char pinTaken[MAX_PIN + 1];
+
+// Currency slots: slot 0 is the USD base, others map to currency instruments
+static int currencyInstrument[MAX_CURRENCIES] = {-1};
+static int instrumentCurrency[MAX_INSTRUMENTS];
+static int currencyCount = 1;
+
+// Cross-rate cache, valid while both currencies' epochs are unchanged
+static unsigned int currencyEpoch[MAX_CURRENCIES] = {1};
+static CrossRate crossRates[MAX_CURRENCIES][MAX_CURRENCIES];
+
+// Direct quotes (0 = none) and pairs blocked by the arbitrage detector
+static float directRates[MAX_CURRENCIES][MAX_CURRENCIES];
+static bool blockedPairs[MAX_CURRENCIES][MAX_CURRENCIES];
+static DirectQuote directQuotes[MAX_DIRECT_QUOTES];
+static int directQuoteCount = 0;
+
+// ==================== ALLOCATION TRACKING ====================
+
+// Built with -DBANK_ALLOC_TRACKING, malloc/calloc/realloc/free are replaced
+// by counting wrappers around glibc's own allocator. Every call is charged
+// to the subsystem and the operation the calling thread is inside.
+static AllocCounters allocBySubsystem[ALLOC_SUBSYSTEM_COUNT];
+static AllocCounters allocByOperation[OP_INTEREST + 1];   // Slot 0: outside any operation
+
+static const char *const ALLOC_SUBSYSTEM_NAMES[ALLOC_SUBSYSTEM_COUNT] = {
+    "other", "account_table", "name_index", "journal", "persistence",
+    "request_engine", "forex", "diagnostics", "workload"
+};
+
+#ifdef BANK_ALLOC_TRACKING
+static _Thread_local int allocSubsystem = ALLOC_OTHER;
+static _Thread_local int allocOperation = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+static void allocCharge(size_t bytes) {
+    AllocCounters *counters[2] = {&allocBySubsystem[allocSubsystem], &allocByOperation[allocOperation]};
+    for (int i = 0; i < 2; i++) {
+        atomic_fetch_add_explicit(&counters[i]->allocations, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&counters[i]->bytes, bytes, memory_order_relaxed);
     }
-    
-    // Write all accounts
-    if (fwrite(accounts, sizeof(Account), accountCount, file) != (size_t)accountCount) {
-        fclose(file);
-        return ERROR_FILE_IO;
+}
+
+static void allocRelease(void) {
+    atomic_fetch_add_explicit(&allocBySubsystem[allocSubsystem].frees, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocByOperation[allocOperation].frees, 1, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    allocCharge(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocCharge(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    allocCharge(size);
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+    if (pointer != NULL) {
+        allocRelease();
     }
-    
-    fclose(file);
-    return SUCCESS;
+    __libc_free(pointer);
 }
 
-/**
- * Load accounts from persistent storage
- */
-ErrorCode loadAccounts(void) {
-    FILE *file = fopen(DATA_FILE, "rb");
+static int allocScopeBegin(int subsystem) {
+    int previous = allocSubsystem;
+    allocSubsystem = subsystem;
+    return previous;
+}
+
+static void allocScopeEnd(int *previous) {
+    allocSubsystem = *previous;
+}
+
+static int allocOperationBegin(int op) {
+    int previous = allocOperation;
+    allocOperation = op >= OP_LOGIN && op <= OP_INTEREST ? op : 0;
+    return previous;
+}
+
+static void allocOperationEnd(int *previous) {
+    allocOperation = *previous;
+}
+#endif
+
+// ==================== TRACING ====================
+
+static const char *traceFilePath = NULL;       // Tracing is on when set
+static _Atomic(TraceBuffer *) traceBuffers = NULL;
+static _Thread_local TraceBuffer *traceLocal = NULL;
+
+static long long traceNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Append a span mark to the calling thread's buffer, creating and
+ * registering the buffer on the thread's first mark
+ */
+void traceRecord(const char *name, char phase) {
+    TraceBuffer *buffer = traceLocal;
+    if (buffer == NULL) {
+        ALLOC_SCOPE(ALLOC_DIAGNOSTICS);
+        buffer = calloc(1, sizeof(TraceBuffer));
+        if (buffer == NULL) {
+            return;
+        }
+        buffer->tid = (int)syscall(SYS_gettid);
+        TraceBuffer *head = atomic_load(&traceBuffers);
+        do {
+            buffer->next = head;
+        } while (!atomic_compare_exchange_weak(&traceBuffers, &head, buffer));
+        traceLocal = buffer;
+    }
+    
+    int count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    if (count >= TRACE_BUFFER_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+    buffer->events[count] = (TraceEvent){name, traceNow(), phase};
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+static const char *traceScopeBegin(const char *name) {
+    if (traceFilePath == NULL) {
+        return NULL;
+    }
+    traceRecord(name, 'B');
+    return name;
+}
+
+static void traceScopeEnd(const char **name) {
+    if (*name != NULL) {
+        traceRecord(*name, 'E');
+    }
+}
+
+/**
+ * Write every thread's spans as a Chrome trace (chrome://tracing or
+ * Perfetto). Registered with atexit() when tracing is enabled.
+ */
+void writeTrace(void) {
+    FILE *file = fopen(traceFilePath, "w");
+    if (file == NULL) {
+        printf("\n[WARNING] Could not write trace file %s.\n", traceFilePath);
+        return;
+    }
+    
+    int pid = (int)getpid();
+    unsigned long dropped = 0;
+    bool first = true;
+    fprintf(file, "{\"traceEvents\": [\n");
+    for (TraceBuffer *buffer = atomic_load(&traceBuffers); buffer != NULL; buffer = buffer->next) {
+        int count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            const TraceEvent *event = &buffer->events[i];
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %lld, \"pid\": %d, \"tid\": %d}",
+                    first ? "" : ",\n", event->name, event->phase, event->timestamp, pid, buffer->tid);
+            first = false;
+        }
+        dropped += buffer->dropped;
+    }
+    fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    fclose(file);
+    
+    if (dropped > 0) {
+        printf("\n[WARNING] Trace buffers overflowed; %lu span mark(s) dropped.\n", dropped);
+    }
+}
+
+// ==================== METRICS ====================
+
+// Counters are split into per-CPU shards so concurrent writers never share
+// a cache line; a scrape sums the shards and computes gauges on demand.
+static MetricShard metricShards[METRIC_SHARDS];
+static atomic_uint *metricQueueDepth = NULL;   // The daemon's queue gauge while it runs
+
+// Held while the exporter reads the daemon's ring region or queue gauge;
+// the daemon publishes and withdraws both under it, so neither is read
+// after the region is unmapped
+static pthread_mutex_t ringRegionLock = PTHREAD_MUTEX_INITIALIZER;
+static const char *metricsFilePath = NULL;
+static pthread_t metricsThread;
+static atomic_bool metricsStopping = false;
+
+// Held for writing while the account table is reallocated, so the exporter
+// can scan balances from its own thread. The hot path never takes it.
+static pthread_rwlock_t accountTableLock = PTHREAD_RWLOCK_INITIALIZER;
+
+static const char *const METRIC_OP_LABELS[OP_INTEREST + 1] = {
+    NULL, "login", "deposit", "withdraw", "status", "purchase", "loan", "convert", "interest"
+};
+static const char *const METRIC_EVENT_LABELS[EVENT_CURRENCY_CONVERSION + 1] = {
+    NULL, "account_created", "deposit", "withdrawal", "asset_purchase",
+    "loan_taken", "loan_repaid", "interest", "currency_conversion"
+};
+static const char *const METRIC_STATUS_LABELS[METRIC_STATUSES] = {
+    "success", "insufficient_funds", "invalid_pin", "account_exists",
+    "file_io", "invalid_input", "rate_blocked", "busy"
+};
+static const long long SAVE_LATENCY_BOUNDS[SAVE_LATENCY_BUCKETS] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+
+static MetricShard *metricShard(void) {
+    int cpu = sched_getcpu();
+    return &metricShards[cpu > 0 ? cpu & (METRIC_SHARDS - 1) : 0];
+}
+
+/**
+ * Count a request executed by the engine or refused by the daemon
+ */
+void metricRequest(int op, ErrorCode status) {
+    if (op < OP_LOGIN || op > OP_INTEREST || (unsigned)status >= METRIC_STATUSES) {
+        return;
+    }
+    atomic_fetch_add_explicit(&metricShard()->requests[op][status], 1, memory_order_relaxed);
+}
+
+/**
+ * Count a committed or rejected event
+ */
+void metricEvent(int type, ErrorCode status) {
+    if (type < EVENT_ACCOUNT_CREATED || type > EVENT_CURRENCY_CONVERSION || (unsigned)status >= METRIC_STATUSES) {
+        return;
+    }
+    atomic_fetch_add_explicit(&metricShard()->events[type][status], 1, memory_order_relaxed);
+}
+
+/**
+ * Record how long one save of the account file took
+ */
+void metricSaveLatency(long long micros) {
+    MetricShard *shard = metricShard();
+    int bucket = 0;
+    while (bucket < SAVE_LATENCY_BUCKETS && micros > SAVE_LATENCY_BOUNDS[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&shard->saveBuckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->saveMicros, (unsigned long long)micros, memory_order_relaxed);
+}
+
+static unsigned long long sumShards(size_t offset) {
+    unsigned long long total = 0;
+    for (int s = 0; s < METRIC_SHARDS; s++) {
+        total += atomic_load_explicit((atomic_ullong *)((char *)&metricShards[s] + offset), memory_order_relaxed);
+    }
+    return total;
+}
+
+// ==================== LOGGING ====================
+
+static const char *logFilePath = NULL;         // Logging is on when set
+static FILE *logFile = NULL;
+static _Atomic(LogRing *) logRings = NULL;
+static _Thread_local LogRing *logLocal = NULL;
+static pthread_t logThread;
+static atomic_bool logStopping = false;
+static atomic_size_t logBufferBytes = 0;        // logFile's buffer size, published by the writer
+
+/**
+ * Append a record to the calling thread's ring, creating and registering
+ * the ring on the thread's first record. A full ring drops the record
+ * rather than wait for the writer.
+ */
+void logRecord(int id, int a, int b, int c, long long value) {
+    LogRing *ring = logLocal;
+    if (ring == NULL) {
+        ALLOC_SCOPE(ALLOC_DIAGNOSTICS);
+        ring = calloc(1, sizeof(LogRing));
+        if (ring == NULL) {
+            return;
+        }
+        ring->tid = (int)syscall(SYS_gettid);
+        LogRing *head = atomic_load(&logRings);
+        do {
+            ring->next = head;
+        } while (!atomic_compare_exchange_weak(&logRings, &head, ring));
+        logLocal = ring;
+    }
+    
+    unsigned int position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (position - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_RECORDS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ring->records[position % LOG_RING_RECORDS] =
+        (LogRecord){(long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000, id, {a, b, c}, value};
+    atomic_store_explicit(&ring->head, position + 1, memory_order_release);
+}
+
+static const char *logLabel(const char *const *labels, int count, int value) {
+    return value >= 0 && value < count && labels[value] != NULL ? labels[value] : "unknown";
+}
+
+/**
+ * Format one record as a timestamped key=value line
+ */
+static void formatLogRecord(FILE *out, const LogRecord *record, int tid) {
+    time_t seconds = (time_t)(record->timestamp / 1000000LL);
+    struct tm local;
+    char stamp[32];
+    localtime_r(&seconds, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    fprintf(out, "%s.%06lld tid=%d ", stamp, record->timestamp % 1000000LL, tid);
+    
+    const int *args = record->args;
+    switch (record->id) {
+        case LOG_EVENT_COMMITTED:
+            fprintf(out, "%s event=%s account=%d amount=%s%lld.%02lld status=%s\n",
+                    args[2] == SUCCESS ? "[SUCCESS]" : "[ERROR]",
+                    logLabel(METRIC_EVENT_LABELS, EVENT_CURRENCY_CONVERSION + 1, args[0]), args[1],
+                    record->value < 0 ? "-" : "", llabs(record->value) / 100, llabs(record->value) % 100,
+                    logLabel(METRIC_STATUS_LABELS, METRIC_STATUSES, args[2]));
+            break;
+        case LOG_REQUEST_REFUSED:
+            fprintf(out, "[WARNING] request refused op=%s account=%d client=%d status=busy\n",
+                    logLabel(METRIC_OP_LABELS, OP_INTEREST + 1, args[0]), args[1], args[2]);
+            break;
+        case LOG_QUEUE_SHEDDING:
+            fprintf(out, "[WARNING] queue over limit depth=%d clients=%d fair_share=%d\n",
+                    args[0], args[1], args[2]);
+            break;
+        case LOG_SAVE:
+            fprintf(out, "%s save accounts=%d status=%s micros=%lld\n",
+                    args[1] == SUCCESS ? "[INFO]" : "[ERROR]", args[0],
+                    logLabel(METRIC_STATUS_LABELS, METRIC_STATUSES, args[1]), record->value);
+            break;
+        case LOG_CLIENT_REAPED:
+            fprintf(out, "[INFO] client released slot=%d pid=%d\n", args[0], args[1]);
+            break;
+        default:
+            fprintf(out, "[WARNING] unknown record id=%d\n", record->id);
+    }
+}
+
+/**
+ * Format every record queued so far and return how many were written
+ */
+static unsigned long drainLogRings(void) {
+    unsigned long written = 0;
+    for (LogRing *ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            formatLogRecord(logFile, &ring->records[tail % LOG_RING_RECORDS], ring->tid);
+            written++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        
+        unsigned long dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            fprintf(logFile, "[WARNING] tid=%d ring full; %lu record(s) dropped\n", ring->tid, dropped);
+        }
+    }
+    return written;
+}
+
+/**
+ * Writer thread: drain all rings, flush the batch with one write, and
+ * sleep while there is nothing new
+ */
+static void *logWriterMain(void *arg) {
+    (void)arg;
+    while (!atomic_load(&logStopping)) {
+        if (drainLogRings() > 0) {
+            fflush(logFile);
+            atomic_store_explicit(&logBufferBytes, __fbufsize(logFile), memory_order_relaxed);
+        } else {
+            usleep(LOG_FLUSH_MICROS);
+        }
+    }
+    drainLogRings();
+    fflush(logFile);
+    return NULL;
+}
+
+/**
+ * Stop the writer after it drains what is queued. Registered with
+ * atexit() when logging is enabled.
+ */
+void stopLogger(void) {
+    atomic_store(&logStopping, true);
+    pthread_join(logThread, NULL);
+    fclose(logFile);
+}
+
+/**
+ * Open `path` for appending and start the writer thread
+ */
+ErrorCode startLogger(const char *path) {
+    ALLOC_SCOPE(ALLOC_DIAGNOSTICS);
+    logFile = fopen(path, "a");
+    if (logFile == NULL) {
+        return ERROR_FILE_IO;
+    }
+    if (pthread_create(&logThread, NULL, logWriterMain, NULL) != 0) {
+        fclose(logFile);
+        logFile = NULL;
+        return ERROR_FILE_IO;
+    }
+    logFilePath = path;
+    atexit(stopLogger);
+    return SUCCESS;
+}
+
+// ==================== UTILITY FUNCTIONS ====================
+
+/**
+ * Clear input buffer to prevent scanf issues
+ */
+void clearInputBuffer(void) {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+/**
+ * Validate if string contains only alphabetic characters
+ */
+bool isAlphaString(const char *str) {
+    if (str == NULL || *str == '\0') return false;
+    
+    for (int i = 0; str[i] != '\0'; i++) {
+        if (!isalpha((unsigned char)str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Validate PIN is within valid range
+ */
+bool isValidPIN(int pin) {
+    return (pin >= MIN_PIN && pin <= MAX_PIN);
+}
+
+/**
+ * Safe float input with validation
+ */
+bool getFloatInput(const char *prompt, float *value) {
+    printf("%s", prompt);
+    if (scanf("%f", value) != 1) {
+        clearInputBuffer();
+        return false;
+    }
+    clearInputBuffer();
+    return true;
+}
+
+/**
+ * Safe integer input with validation
+ */
+bool getIntInput(const char *prompt, int *value) {
+    printf("%s", prompt);
+    if (scanf("%d", value) != 1) {
+        clearInputBuffer();
+        return false;
+    }
+    clearInputBuffer();
+    return true;
+}
+
+/**
+ * Display error message based on error code
+ */
+void displayError(ErrorCode error) {
+    switch (error) {
+        case ERROR_INSUFFICIENT_FUNDS:
+            printf("\n[ERROR] Insufficient funds for this transaction.\n");
+            break;
+        case ERROR_INVALID_PIN:
+            printf("\n[ERROR] Invalid PIN entered.\n");
+            break;
+        case ERROR_ACCOUNT_EXISTS:
+            printf("\n[ERROR] Account with this name or PIN already exists.\n");
+            break;
+        case ERROR_FILE_IO:
+            printf("\n[ERROR] File operation failed.\n");
+            break;
+        case ERROR_INVALID_INPUT:
+            printf("\n[ERROR] Invalid input provided.\n");
+            break;
+        case ERROR_RATE_BLOCKED:
+            printf("\n[ERROR] Conversion blocked: inconsistent exchange quotes.\n");
+            break;
+        case ERROR_BUSY:
+            printf("\n[ERROR] Server busy; request was not applied, retry later.\n");
+            break;
+        default:
+            printf("\n[ERROR] An unknown error occurred.\n");
+    }
+}
+
+// ==================== PAGE ALLOCATION ====================
+
+// With --huge-pages, tables of half a huge page or more move from the heap
+// to anonymous mappings on explicit (hugetlbfs) pages, or failing that on
+// regular pages advised for transparent huge pages
+static bool hugePagesEnabled = false;
+static bool explicitHugePagesFailed = false;
+static PageBacking accountsBacking = PAGES_HEAP;
+static PageBacking holdingsBacking[MAX_INSTRUMENTS];
+static PageBacking nameIndexBacking = PAGES_HEAP;
+
+static const char *const PAGE_BACKING_NAMES[] = {
+    "heap", "regular pages (transparent huge pages unavailable)",
+    "transparent huge pages", "explicit huge pages"
+};
+
+static size_t hugePageRound(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+}
+
+/**
+ * Map `bytes` of zeroed memory, preferring explicit huge pages
+ */
+static void *mapTable(size_t bytes, PageBacking *backing) {
+    size_t length = hugePageRound(bytes);
+    if (!explicitHugePagesFailed) {
+        void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            *backing = PAGES_EXPLICIT;
+            return memory;
+        }
+        explicitHugePagesFailed = true; // Pool empty or not configured; stop asking
+    }
+    
+    void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    *backing = madvise(memory, length, MADV_HUGEPAGE) == 0 ? PAGES_TRANSPARENT : PAGES_MAPPED;
+    return memory;
+}
+
+/**
+ * Bytes actually held by a table buffer of `bytes`
+ */
+size_t tableReservation(size_t bytes, PageBacking backing) {
+    return backing == PAGES_HEAP ? bytes : hugePageRound(bytes);
+}
+
+/**
+ * Release a table buffer of `bytes` allocated by growTable()
+ */
+void releaseTable(void *memory, size_t bytes, PageBacking backing) {
+    if (memory == NULL) {
+        return;
+    }
+    if (backing == PAGES_HEAP) {
+        free(memory);
+    } else {
+        munmap(memory, tableReservation(bytes, backing));
+    }
+}
+
+/**
+ * Resize a table buffer from `oldBytes` to `newBytes`, keeping its contents
+ * and zeroing the new tail. A buffer reaching HUGE_PAGE_MIN_BYTES with huge
+ * pages enabled moves to a mapping; mappings grow in place when the kernel
+ * can extend them. Returns NULL, leaving the old buffer intact, on failure.
+ */
+void *growTable(void *memory, size_t oldBytes, size_t newBytes, PageBacking *backing) {
+    if (memory == NULL) {
+        *backing = PAGES_HEAP;
+    }
+    
+    if (*backing == PAGES_HEAP && (!hugePagesEnabled || newBytes < HUGE_PAGE_MIN_BYTES)) {
+        char *grown = realloc(memory, newBytes);
+        if (grown != NULL && newBytes > oldBytes) {
+            memset(grown + oldBytes, 0, newBytes - oldBytes);
+        }
+        return grown;
+    }
+    
+    if (*backing != PAGES_HEAP) {
+        void *grown = mremap(memory, hugePageRound(oldBytes), hugePageRound(newBytes), MREMAP_MAYMOVE);
+        if (grown != MAP_FAILED) {
+            return grown; // Anonymous pages added by the kernel arrive zeroed
+        }
+    }
+    
+    PageBacking mapped;
+    void *grown = mapTable(newBytes, &mapped);
+    if (grown == NULL) {
+        if (*backing != PAGES_HEAP) {
+            return NULL;
+        }
+        hugePagesEnabled = false; // Out of address space for mappings; stay on the heap
+        return growTable(memory, oldBytes, newBytes, backing);
+    }
+    if (memory != NULL) {
+        memcpy(grown, memory, oldBytes < newBytes ? oldBytes : newBytes);
+        releaseTable(memory, oldBytes, *backing);
+    }
+    *backing = mapped;
+    return grown;
+}
+
+/**
+ * Report where the account table, holdings and name index ended up
+ */
+void reportPageBacking(void) {
+    if (sharedStore != NULL) {
+        printf("[INFO] Huge pages: account table in the shared region, name index on %s.\n",
+               PAGE_BACKING_NAMES[nameIndexBacking]);
+    } else {
+        printf("[INFO] Huge pages: account table on %s, holdings on %s, name index on %s.\n",
+               PAGE_BACKING_NAMES[accountsBacking], PAGE_BACKING_NAMES[holdingsBacking[0]],
+               PAGE_BACKING_NAMES[nameIndexBacking]);
+    }
+    if (explicitHugePagesFailed) {
+        printf("[INFO] No explicit huge pages were available (see /proc/sys/vm/nr_hugepages); "
+               "transparent huge pages were requested instead.\n");
+    }
+    if (accountsBacking == PAGES_HEAP && sharedStore == NULL) {
+        printf("[INFO] Tables under %d KB stay on the heap until they grow.\n", HUGE_PAGE_MIN_BYTES / 1024);
+    }
+}
+
+// ==================== INSTRUMENT REGISTRY ====================
+
+/**
+ * Register a new instrument and return its id (-1 if the registry is full)
+ */
+int registerInstrument(const char *code, const char *name, InstrumentKind kind,
+                       float price, int minChangePct, int changeSpanPct) {
+    if (instrumentCount >= MAX_INSTRUMENTS) {
+        return -1;
+    }
+    if (kind == INSTRUMENT_CURRENCY && currencyCount >= MAX_CURRENCIES) {
+        return -1;
+    }
+
+    int id = instrumentCount++;
+    Instrument *instrument = &instruments[id];
+
+    strncpy(instrument->code, code, INSTRUMENT_CODE_LENGTH - 1);
+    instrument->code[INSTRUMENT_CODE_LENGTH - 1] = '\0';
+    strncpy(instrument->name, name, INSTRUMENT_NAME_LENGTH - 1);
+    instrument->name[INSTRUMENT_NAME_LENGTH - 1] = '\0';
+    instrument->kind = kind;
+    instrument->minChangePct = minChangePct;
+    instrument->changeSpanPct = changeSpanPct;
+
+    instrumentPrices[id] = price;
+    ALLOC_SCOPE(ALLOC_ACCOUNT_TABLE);
+    size_t columnBytes = sizeof(float) * (size_t)(accountCapacity > 0 ? accountCapacity : 1);
+    releaseTable(holdings[id], columnBytes, holdingsBacking[id]);
+    holdings[id] = growTable(NULL, 0, columnBytes, &holdingsBacking[id]);
+    if (holdings[id] == NULL) {
+        return -1;
+    }
+
+    instrumentCurrency[id] = -1;
+    if (kind == INSTRUMENT_CURRENCY) {
+        int slot = currencyCount++;
+        currencyInstrument[slot] = id;
+        instrumentCurrency[id] = slot;
+        currencyEpoch[slot]++;
+    }
+
+    return id;
+}
+
+/**
+ * Set an instrument's USD price, invalidating cached cross rates if it is a currency
+ */
+void setInstrumentPrice(int id, float price) {
+    instrumentPrices[id] = price;
+    if (instrumentCurrency[id] >= 0) {
+        currencyEpoch[instrumentCurrency[id]]++;
+    }
+}
+
+/**
+ * Register the built-in assets and currencies
+ */
+void registerDefaultInstruments(void) {
+    registerInstrument("CRYPTO", "Cryptocurrency", INSTRUMENT_ASSET, 150.0f, -15, 35);
+    registerInstrument("GOLD", "Gold", INSTRUMENT_ASSET, 60.0f, -5, 15);
+    registerInstrument("SILVER", "Silver", INSTRUMENT_ASSET, 25.0f, -10, 25);
+
+    registerInstrument("EUR", "Euro", INSTRUMENT_CURRENCY, 1.10f, 0, 0);
+    registerInstrument("GBP", "British Pound", INSTRUMENT_CURRENCY, 1.27f, 0, 0);
+    registerInstrument("INR", "Indian Rupee", INSTRUMENT_CURRENCY, 0.012f, 0, 0);
+}
+
+/**
+ * Look up an instrument id by its code (-1 if not registered)
+ */
+int findInstrument(const char *code) {
+    for (int i = 0; i < instrumentCount; i++) {
+        if (strcmp(instruments[i].code, code) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Map a 1-based menu choice to the n-th instrument of a kind (-1 if none)
+ */
+int instrumentByMenuChoice(InstrumentKind kind, int choice) {
+    int n = 0;
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == kind && ++n == choice) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Value an account's holdings in USD, accumulated per instrument kind
+ */
+void valueHoldings(int accountIndex, float totals[INSTRUMENT_KIND_COUNT]) {
+    for (int k = 0; k < INSTRUMENT_KIND_COUNT; k++) {
+        totals[k] = 0.0f;
+    }
+
+    for (int i = 0; i < instrumentCount; i++) {
+        totals[instruments[i].kind] += holdings[i][accountIndex] * instrumentPrices[i];
+    }
+}
+
+// ==================== STATE INTEGRITY ====================
+
+#define FNV_OFFSET_BASIS 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+static unsigned long long fnv1a(unsigned long long hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Hash of one account slot: identity, cash, loan and holdings. Journal
+ * bookkeeping is left out so copies compare equal on state alone.
+ */
+unsigned long long hashAccountState(int index) {
+    if (index >= accountCount) {
+        return 0; // Empty slot
+    }
+    
+    const Account *account = &accounts[index];
+    unsigned long long hash = FNV_OFFSET_BASIS;
+    hash = fnv1a(hash, account->name, strnlen(account->name, MAX_NAME_LENGTH));
+    hash = fnv1a(hash, &account->pin, sizeof(account->pin));
+    hash = fnv1a(hash, &account->balance, sizeof(account->balance));
+    hash = fnv1a(hash, &account->loan, sizeof(account->loan));
+    for (int i = 0; i < instrumentCount; i++) {
+        hash = fnv1a(hash, &holdings[i][index], sizeof(float));
+    }
+    return hash;
+}
+
+static unsigned long long merkleCombine(unsigned long long left, unsigned long long right) {
+    if (left == 0 && right == 0) {
+        return 0; // Empty subtrees stay empty, so trailing slots cost nothing
+    }
+    unsigned long long hash = fnv1a(FNV_OFFSET_BASIS, &left, sizeof(left));
+    return fnv1a(hash, &right, sizeof(right));
+}
+
+/**
+ * Allocate a tree with at least the given number of leaves
+ */
+bool merkleInit(MerkleTree *tree, int minLeaves) {
+    ALLOC_SCOPE(ALLOC_ACCOUNT_TABLE);
+    tree->leafCount = 1;
+    while (tree->leafCount < minLeaves) {
+        tree->leafCount <<= 1;
+    }
+    tree->nodes = calloc(2 * (size_t)tree->leafCount, sizeof(unsigned long long));
+    return tree->nodes != NULL;
+}
+
+/**
+ * Re-hash one account and update its path to the root in O(log N)
+ */
+void merkleUpdate(MerkleTree *tree, int index) {
+    if (tree->nodes == NULL || index < 0 || index >= tree->leafCount) {
+        return;
+    }
+    
+    int node = tree->leafCount + index;
+    tree->nodes[node] = hashAccountState(index);
+    for (node /= 2; node >= 1; node /= 2) {
+        tree->nodes[node] = merkleCombine(tree->nodes[2 * node], tree->nodes[2 * node + 1]);
+    }
+}
+
+/**
+ * Rebuild the whole tree bottom-up from in-memory state in O(N)
+ */
+void merkleRebuild(MerkleTree *tree) {
+    TRACE_SCOPE("merkleRebuild");
+    if (tree->nodes == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < tree->leafCount; i++) {
+        tree->nodes[tree->leafCount + i] = hashAccountState(i);
+    }
+    for (int node = tree->leafCount - 1; node >= 1; node--) {
+        tree->nodes[node] = merkleCombine(tree->nodes[2 * node], tree->nodes[2 * node + 1]);
+    }
+}
+
+/**
+ * Collect the slots whose hashes differ between two equally sized trees by
+ * descending only into differing subtrees: O(d log N) for d differences
+ */
+int merkleDiff(const MerkleTree *a, const MerkleTree *b, int node, int *differences, int maxDifferences) {
+    if (a->nodes[node] == b->nodes[node] || maxDifferences <= 0) {
+        return 0;
+    }
+    if (node >= a->leafCount) {
+        differences[0] = node - a->leafCount;
+        return 1;
+    }
+    
+    int found = merkleDiff(a, b, 2 * node, differences, maxDifferences);
+    return found + merkleDiff(a, b, 2 * node + 1, differences + found, maxDifferences - found);
+}
+
+// ==================== ACCOUNT TABLE ====================
+
+/**
+ * Make room for at least `needed` accounts, doubling the table and every
+ * holdings column and resizing the hash tree. A shared region has a fixed
+ * size and cannot grow.
+ */
+bool ensureAccountCapacity(int needed) {
+    if (needed <= accountCapacity) {
+        return true;
+    }
+    ALLOC_SCOPE(ALLOC_ACCOUNT_TABLE);
+    if (sharedStore != NULL || needed > MAX_ACCOUNTS) {
+        return false;
+    }
+    
+    int capacity = accountCapacity > 0 ? accountCapacity : INITIAL_ACCOUNT_CAPACITY;
+    while (capacity < needed) {
+        capacity = capacity > MAX_ACCOUNTS / 2 ? MAX_ACCOUNTS : capacity * 2;
+    }
+    
+    pthread_rwlock_wrlock(&accountTableLock);
+    Account *grown = growTable(accounts, sizeof(Account) * (size_t)accountCapacity,
+                               sizeof(Account) * (size_t)capacity, &accountsBacking);
+    if (grown != NULL) {
+        accounts = grown;
+    }
+    pthread_rwlock_unlock(&accountTableLock);
+    if (grown == NULL) {
+        return false;
+    }
+    
+    for (int i = 0; i < instrumentCount; i++) {
+        float *column = growTable(holdings[i], sizeof(float) * (size_t)accountCapacity,
+                                  sizeof(float) * (size_t)capacity, &holdingsBacking[i]);
+        if (column == NULL) {
+            return false;
+        }
+        holdings[i] = column;
+    }
+    accountCapacity = capacity;
+    
+    MerkleTree tree;
+    if (!merkleInit(&tree, capacity)) {
+        return false;
+    }
+    free(stateTree.nodes);
+    stateTree = tree;
+    merkleRebuild(&stateTree);
+    return true;
+}
+
+/**
+ * Forget the name index after the account table was replaced wholesale
+ */
+void invalidateAccountIndex(void) {
+    indexedCount = 0;
+    memset(pinTaken, 0, sizeof(pinTaken));
+    if (nameIndex != NULL) {
+        memset(nameIndex, 0xff, sizeof(int) * (size_t)nameIndexSize);
+    }
+}
+
+static unsigned int nameSlot(const char *name) {
+    return (unsigned int)fnv1a(FNV_OFFSET_BASIS, name, strnlen(name, MAX_NAME_LENGTH)) & (unsigned int)(nameIndexSize - 1);
+}
+
+/**
+ * Index accounts appended since the last call, rehashing when the index
+ * passes half full
+ */
+static void refreshAccountIndex(void) {
+    if (indexedCount > accountCount) {
+        invalidateAccountIndex();
+    }
+    if (indexedCount == accountCount) {
+        return;
+    }
+    
+    if (nameIndexSize < 2 * accountCount) {
+        int size = nameIndexSize > 0 ? nameIndexSize : 2 * INITIAL_ACCOUNT_CAPACITY;
+        while (size < 2 * accountCount) {
+            size *= 2;
+        }
+        ALLOC_SCOPE(ALLOC_NAME_INDEX);
+        PageBacking backing;
+        int *table = growTable(NULL, 0, sizeof(int) * (size_t)size, &backing);
+        if (table == NULL) {
+            return;
+        }
+        releaseTable(nameIndex, sizeof(int) * (size_t)nameIndexSize, nameIndexBacking);
+        nameIndex = table;
+        nameIndexBacking = backing;
+        nameIndexSize = size;
+        invalidateAccountIndex();
+    }
+    
+    for (; indexedCount < accountCount; indexedCount++) {
+        unsigned int slot = nameSlot(accounts[indexedCount].name);
+        while (nameIndex[slot] >= 0) {
+            slot = (slot + 1) & (unsigned int)(nameIndexSize - 1);
+        }
+        nameIndex[slot] = indexedCount;
+        if (accounts[indexedCount].pin >= 0 && accounts[indexedCount].pin <= MAX_PIN) {
+            pinTaken[accounts[indexedCount].pin] = 1;
+        }
+    }
+}
+
+/**
+ * Find an account index by holder name (-1 if not found)
+ */
+int findAccount(const char *name) {
+    refreshAccountIndex();
+    if (indexedCount < accountCount) {
+        // Index could not grow; fall back to a scan
+        for (int i = 0; i < accountCount; i++) {
+            if (strcmp(accounts[i].name, name) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    if (nameIndexSize == 0) {
+        return -1;
+    }
+    
+    for (unsigned int slot = nameSlot(name); nameIndex[slot] >= 0;
+         slot = (slot + 1) & (unsigned int)(nameIndexSize - 1)) {
+        if (strcmp(accounts[nameIndex[slot]].name, name) == 0) {
+            return nameIndex[slot];
+        }
+    }
+    return -1;
+}
+
+/**
+ * Check if account name or PIN already exists
+ */
+bool accountExists(const char *name, int pin) {
+    if (findAccount(name) >= 0) {
+        return true;
+    }
+    if (indexedCount == accountCount && pin >= 0 && pin <= MAX_PIN) {
+        return pinTaken[pin] != 0;
+    }
+    for (int i = 0; i < accountCount; i++) {
+        if (accounts[i].pin == pin) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ==================== SHARED STORE ====================
+
+static size_t sharedAccountsOffset(void) {
+    return (sizeof(SharedStoreHeader) + 63) & ~(size_t)63;
+}
+
+static size_t sharedHoldingsOffset(void) {
+    return sharedAccountsOffset() + ((sizeof(Account) * SHARED_STORE_CAPACITY + 63) & ~(size_t)63);
+}
+
+static size_t sharedMerkleOffset(void) {
+    return sharedHoldingsOffset() + sizeof(float) * MAX_INSTRUMENTS * SHARED_STORE_CAPACITY;
+}
+
+/**
+ * Map the shared account region, creating it if this is the first process.
+ * The creator must load state and then call publishSharedStore(); other
+ * processes wait for that before using the region.
+ */
+ErrorCode attachSharedStore(bool *created) {
+    MerkleTree layout;
+    if (!merkleInit(&layout, SHARED_STORE_CAPACITY)) {
+        return ERROR_FILE_IO;
+    }
+    free(layout.nodes);
+    size_t size = sharedMerkleOffset() + sizeof(unsigned long long) * 2 * (size_t)layout.leafCount;
+    
+    *created = true;
+    int fd = shm_open(SHARED_STORE_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        *created = false;
+        fd = shm_open(SHARED_STORE_NAME, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return ERROR_FILE_IO;
+    }
+    
+    if (*created && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(SHARED_STORE_NAME);
+        return ERROR_FILE_IO;
+    }
+    
+    // A joining process may race the creator's ftruncate
+    struct stat info;
+    struct timespec pause = {0, 1000000L};
+    for (long waited = 0;; waited += 1000) {
+        if (fstat(fd, &info) != 0 || ((size_t)info.st_size < size && waited >= SHARED_STORE_WAIT_MICROS)) {
+            close(fd);
+            return ERROR_FILE_IO;
+        }
+        if ((size_t)info.st_size >= size) {
+            break;
+        }
+        nanosleep(&pause, NULL);
+    }
+    
+    unsigned char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return ERROR_FILE_IO;
+    }
+    SharedStoreHeader *header = (SharedStoreHeader *)base;
+    
+    if (*created) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        
+        header->capacity = SHARED_STORE_CAPACITY;
+        header->instrumentCount = instrumentCount;
+        header->merkleLeaves = layout.leafCount;
+    } else {
+        for (long waited = 0; __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_STORE_MAGIC;
+             waited += 1000) {
+            if (waited >= SHARED_STORE_WAIT_MICROS) {
+                munmap(base, size);
+                return ERROR_FILE_IO; // Creator died before publishing
+            }
+            nanosleep(&pause, NULL);
+        }
+        if (header->capacity != SHARED_STORE_CAPACITY || header->instrumentCount != instrumentCount) {
+            munmap(base, size);
+            return ERROR_INVALID_INPUT; // Built with a different layout
+        }
+    }
+    
+    // Replace the private table with the region's fixed-size one
+    releaseTable(accounts, sizeof(Account) * (size_t)accountCapacity, accountsBacking);
+    accounts = (Account *)(base + sharedAccountsOffset());
+    accountsBacking = PAGES_HEAP;
+    for (int i = 0; i < instrumentCount; i++) {
+        releaseTable(holdings[i], sizeof(float) * (size_t)accountCapacity, holdingsBacking[i]);
+        holdingsBacking[i] = PAGES_HEAP;
+        holdings[i] = (float *)(base + sharedHoldingsOffset()) + (size_t)i * SHARED_STORE_CAPACITY;
+    }
+    accountCapacity = SHARED_STORE_CAPACITY;
+    free(stateTree.nodes);
+    stateTree.leafCount = header->merkleLeaves;
+    stateTree.nodes = (unsigned long long *)(base + sharedMerkleOffset());
+    sharedStore = header;
+    
+    if (!*created) {
+        accountCount = header->accountCount;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Publish the creator's loaded state so waiting processes can start
+ */
+void publishSharedStore(void) {
+    if (sharedStore == NULL) {
+        return;
+    }
+    sharedStore->accountCount = accountCount;
+    sharedStore->journalSequence = journalSequence;
+    sharedStore->postingsLength = postingsFile != NULL ? ftell(postingsFile) : 0;
+    __atomic_store_n(&sharedStore->magic, SHARED_STORE_MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+ * Take the store lock and pick up the count and journal position other
+ * processes published. A lock left by a crashed process is recovered.
+ */
+void lockStore(void) {
+    if (sharedStore == NULL) {
+        return;
+    }
+    
+    int locked = pthread_mutex_lock(&sharedStore->lock);
+    if (locked == EOWNERDEAD) {
+        // The owner may have died part-way through an event; only mark the
+        // lock usable again once state matches what it last published
+        printf("\n[WARNING] Recovering store lock from a terminated process.\n");
+        if (sharedStoreRecovery == NULL || !sharedStoreRecovery()) {
+            printf("\n[ERROR] Shared store could not be rebuilt; it is no longer usable.\n");
+            pthread_mutex_unlock(&sharedStore->lock); // Leaves it unrecoverable for every process
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_consistent(&sharedStore->lock);
+    } else if (locked != 0) {
+        printf("\n[ERROR] Shared store lock is unusable; a terminated process left it inconsistent.\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    accountCount = sharedStore->accountCount;
+    journalSequence = sharedStore->journalSequence;
+    if (journalFile != NULL) {
+        fseek(journalFile, (long)(journalSequence * sizeof(Event)), SEEK_SET);
+    }
+    if (postingsFile != NULL) {
+        fseek(postingsFile, 0, SEEK_END);
+    }
+}
+
+/**
+ * Flush this process's log writes and publish its changes, then release the lock
+ */
+void unlockStore(void) {
+    if (sharedStore == NULL) {
+        return;
+    }
+    
+    if (journalFile != NULL) {
+        fflush(journalFile);
+    }
+    if (postingsFile != NULL) {
+        fflush(postingsFile);
+        sharedStore->postingsLength = ftell(postingsFile);
+    }
+    sharedStore->accountCount = accountCount;
+    sharedStore->journalSequence = journalSequence;
+    pthread_mutex_unlock(&sharedStore->lock);
+}
+
+/**
+ * Refresh this process's view of accounts other processes created
+ */
+void syncStoreView(void) {
+    lockStore();
+    unlockStore();
+}
+
+// ==================== FILE OPERATIONS ====================
+
+/**
+ * Write a full state snapshot: a versioned header, accounts, then holdings
+ * columns tagged by code
+ */
+bool writeSnapshot(FILE *file) {
+    TRACE_SCOPE("writeSnapshot");
+    SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, sizeof(Account), accountCount, journalSequence,
+                             stateTree.nodes != NULL ? stateTree.leafCount : 0,
+                             stateTree.nodes != NULL ? stateTree.nodes[1] : 0};
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    
+    // Write all accounts
+    if (fwrite(accounts, sizeof(Account), accountCount, file) != (size_t)accountCount) {
+        return false;
+    }
+    
+    // Write holdings one instrument column at a time
+    if (fwrite(&instrumentCount, sizeof(int), 1, file) != 1) {
+        return false;
+    }
+    
+    for (int i = 0; i < instrumentCount; i++) {
+        if (fwrite(instruments[i].code, INSTRUMENT_CODE_LENGTH, 1, file) != 1 ||
+            fwrite(holdings[i], sizeof(float), accountCount, file) != (size_t)accountCount) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * Read a snapshot header. Version 1 headers end before merkleLeaves; their
+ * root is reported as unknown. Returns false if the file does not start
+ * with one (a legacy snapshot); a truncated header comes back as version 0.
+ */
+static bool readSnapshotHeader(FILE *file, SnapshotHeader *header) {
+    const size_t firstVersionSize = offsetof(SnapshotHeader, merkleLeaves);
+    memset(header, 0, sizeof(*header));
+    if (fread(header, firstVersionSize, 1, file) != 1 || header->magic != SNAPSHOT_MAGIC) {
+        return false;
+    }
+    if (header->version >= 2 &&
+        fread((char *)header + firstVersionSize, sizeof(*header) - firstVersionSize, 1, file) != 1) {
+        header->version = 0;
+    }
+    return true;
+}
+
+/**
+ * Work out the record layout of a snapshot written before the header
+ * existed: a bare account count, then either the original fixed-field
+ * accounts or registry-era accounts followed by holdings columns. The
+ * layouts are told apart by the number of bytes that follow the count.
+ * Returns the record size, or 0 if nothing fits.
+ */
+static size_t legacyRecordSize(int count, long remaining) {
+    long long rest = remaining - (long long)sizeof(int);
+    if (rest == (long long)count * (long long)sizeof(LegacyAccount)) {
+        return sizeof(LegacyAccount);
+    }
+    static const size_t registrySizes[] = {LEGACY_REGISTRY_ACCOUNT_SIZE, sizeof(Account)};
+    for (size_t i = 0; i < sizeof(registrySizes) / sizeof(registrySizes[0]); i++) {
+        long long columns = rest - (long long)count * (long long)registrySizes[i] - (long long)sizeof(int);
+        long long columnBytes = INSTRUMENT_CODE_LENGTH + (long long)sizeof(float) * count;
+        if (columns >= 0 && columns % columnBytes == 0 && columns / columnBytes <= MAX_INSTRUMENTS) {
+            return registrySizes[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read `accountCount` account records of `recordSize` bytes. Older layouts
+ * share the name, PIN, balance and loan prefix; the original layout also
+ * carries fixed asset and currency fields, moved here into their columns.
+ */
+static bool readAccountRecords(FILE *file, size_t recordSize) {
+    if (recordSize == sizeof(Account)) {
+        return fread(accounts, sizeof(Account), accountCount, file) == (size_t)accountCount;
+    }
+    
+    static const char *const legacyCodes[] = {"CRYPTO", "GOLD", "SILVER", "EUR", "GBP", "INR"};
+    for (int i = 0; i < accountCount; i++) {
+        LegacyAccount record;
+        memset(&record, 0, sizeof(record));
+        if (fread(&record, recordSize, 1, file) != 1) {
+            return false;
+        }
+        memset(&accounts[i], 0, sizeof(Account));
+        memcpy(accounts[i].name, record.name, MAX_NAME_LENGTH);
+        accounts[i].name[MAX_NAME_LENGTH - 1] = '\0';
+        accounts[i].pin = record.pin;
+        accounts[i].balance = record.balance;
+        accounts[i].loan = record.loan;
+        accounts[i].lastEventOffset = -1;   // The journal did not exist yet
+        
+        if (recordSize == sizeof(LegacyAccount)) {
+            for (int k = 0; k < 6; k++) {
+                int id = findInstrument(legacyCodes[k]);
+                if (id >= 0) {
+                    holdings[id][i] = record.holdings[k];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Read a state snapshot written by writeSnapshot(), or by a build that
+ * predates the snapshot header, into memory. On failure the table is left
+ * empty rather than half read.
+ */
+bool readSnapshot(FILE *file) {
+    TRACE_SCOPE("readSnapshot");
+    invalidateAccountIndex();
+    accountCount = 0;
+    
+    long start = ftell(file);
+    SnapshotHeader header;
+    size_t recordSize = sizeof(Account);
+    int count;
+    if (readSnapshotHeader(file, &header)) {
+        if (header.version < 1 || header.version > SNAPSHOT_VERSION || header.accountSize != sizeof(Account)) {
+            return false;
+        }
+        count = header.accountCount;
+        snapshotSequence = header.journalSequence;
+    } else {
+        struct stat info;
+        if (fseek(file, start, SEEK_SET) != 0 || fread(&count, sizeof(int), 1, file) != 1 ||
+            fstat(fileno(file), &info) != 0 || count < 0 ||
+            (recordSize = legacyRecordSize(count, (long)info.st_size - start)) == 0) {
+            return false;
+        }
+        snapshotSequence = SNAPSHOT_SEQUENCE_UNKNOWN;
+    }
+    if (count < 0 || !ensureAccountCapacity(count)) {
+        return false;
+    }
+    accountCount = count;
+    
+    for (int i = 0; i < instrumentCount; i++) {
+        memset(holdings[i], 0, sizeof(float) * accountCount);
+    }
+    if (!readAccountRecords(file, recordSize)) {
+        accountCount = 0;
+        return false;
+    }
+    
+    // The original layout has no holdings columns
+    int storedInstruments = 0;
+    if (recordSize != sizeof(LegacyAccount) && fread(&storedInstruments, sizeof(int), 1, file) != 1) {
+        accountCount = 0;
+        return false;
+    }
+    
+    // Read holdings columns, matching instruments by code
+    for (int i = 0; i < storedInstruments; i++) {
+        char code[INSTRUMENT_CODE_LENGTH];
+        if (fread(code, INSTRUMENT_CODE_LENGTH, 1, file) != 1) {
+            accountCount = 0;
+            return false;
+        }
+        code[INSTRUMENT_CODE_LENGTH - 1] = '\0';
+        
+        int id = findInstrument(code);
+        if (id < 0) {
+            // Instrument no longer listed - skip its column
+            fseek(file, (long)(sizeof(float) * accountCount), SEEK_CUR);
+            continue;
+        }
+        
+        if (fread(holdings[id], sizeof(float), accountCount, file) != (size_t)accountCount) {
+            accountCount = 0;
+            return false;
+        }
+    }
+    
+    merkleRebuild(&stateTree);
+    return true;
+}
+
+/**
+ * Save all accounts to persistent storage
+ */
+static ErrorCode saveAccountsImpl(void) {
+    TRACE_SCOPE("saveAccounts");
+    ALLOC_SCOPE(ALLOC_PERSISTENCE);
+    // Journal entries must reach the file before the state they produced
+    if ((journalFile != NULL && fflush(journalFile) != 0) ||
+        (postingsFile != NULL && fflush(postingsFile) != 0)) {
+        return ERROR_FILE_IO;
+    }
+    
+    lockStore();
+    if (dataFile == NULL) {
+        dataFile = fopen(DATA_FILE, "wb");
+    }
+    if (dataFile == NULL) {
+        unlockStore();
+        return ERROR_FILE_IO;
+    }
+    
+    // Rewrite in place so the stream and its buffer are reused every save
+    clearerr(dataFile);
+    rewind(dataFile);
+    bool written = writeSnapshot(dataFile) && fflush(dataFile) == 0 &&
+                   ftruncate(fileno(dataFile), ftell(dataFile)) == 0;
+    unlockStore();
+    return written ? SUCCESS : ERROR_FILE_IO;
+}
+
+/**
+ * saveAccountsImpl() between its entry and return probes
+ */
+ErrorCode saveAccounts(void) {
+    PROBE1(save__entry, accountCount);
+    long long started = traceNow();
+    ErrorCode result = saveAccountsImpl();
+    long long elapsed = traceNow() - started;
+    metricSaveLatency(elapsed);
+    LOG_EVENT(LOG_SAVE, accountCount, result, 0, elapsed);
+    PROBE2(save__return, accountCount, result);
+    return result;
+}
+
+/**
+ * Load accounts from persistent storage
+ */
+static ErrorCode loadAccountsImpl(void) {
+    TRACE_SCOPE("loadAccounts");
+    ALLOC_SCOPE(ALLOC_PERSISTENCE);
+    FILE *file = fopen(DATA_FILE, "rb");
+    if (file == NULL) {
+        return SUCCESS; // File doesn't exist yet - not an error
+    }
+    
+    bool loaded = readSnapshot(file);
+    fclose(file);
+    return loaded ? SUCCESS : ERROR_FILE_IO;
+}
+
+/**
+ * loadAccountsImpl() between its entry and return probes
+ */
+ErrorCode loadAccounts(void) {
+    PROBE0(load__entry);
+    ErrorCode result = loadAccountsImpl();
+    PROBE2(load__return, accountCount, result);
+    return result;
+}
+
+/**
+ * Open an append-only file of fixed-size records, positioned after the last
+ * complete record so a torn trailing write is overwritten
+ */
+FILE *openRecordLog(const char *path, size_t recordSize, unsigned long long *records) {
+    FILE *create = fopen(path, "ab");
+    if (create == NULL) {
+        return NULL;
+    }
+    fclose(create);
+    
+    FILE *file = fopen(path, "r+b");
+    if (file == NULL) {
+        return NULL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    *records = (unsigned long long)ftell(file) / recordSize;
+    fseek(file, (long)(*records * recordSize), SEEK_SET);
+    return file;
+}
+
+/**
+ * Cut a record log back to `offset`, discarding records of an event that
+ * failed part-way. The caller flushed up to `offset` before writing, so
+ * everything still buffered belongs to the failed event and is dropped
+ * unwritten; anything an overflowing write already pushed out is cut off.
+ */
+void truncateRecordLog(FILE *file, long offset) {
+    if (file == NULL) {
+        return;
+    }
+    __fpurge(file);
+    clearerr(file);
+    if (ftruncate(fileno(file), offset) != 0 || fseek(file, offset, SEEK_SET) != 0) {
+        printf("\n[WARNING] Could not roll back a partly written log record.\n");
+    }
+}
+
+// ==================== DOUBLE-ENTRY LEDGER ====================
+
+/**
+ * Create an empty event of the given type for an account
+ */
+Event makeEvent(EventType type, int accountIndex) {
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.accountIndex = accountIndex;
+    event.instrument = -1;
+    event.counterInstrument = -1;
+    return event;
+}
+
+
+/**
+ * Bank-side ledger that takes the other half of an event's customer postings
+ */
+LedgerAccount counterLedger(int eventType) {
+    switch (eventType) {
+        case EVENT_DEPOSIT:
+        case EVENT_WITHDRAWAL:
+            return LEDGER_CASH_VAULT;
+        case EVENT_INTEREST:
+            return LEDGER_INTEREST_EXPENSE;
+        case EVENT_ACCOUNT_CREATED:
+            return LEDGER_EQUITY;
+        default:
+            return LEDGER_TRADING;
+    }
+}
+
+/**
+ * Append a non-zero posting to an event's posting list
+ */
+static void addPosting(Posting *postings, int *count, unsigned long long sequence,
+                       LedgerAccount ledger, int accountIndex, int instrument, double amount) {
+    if (amount == 0.0 || *count >= MAX_EVENT_POSTINGS) {
+        return;
+    }
+    postings[*count] = (Posting){sequence, ledger, accountIndex, instrument, amount};
+    (*count)++;
+}
+
+/**
+ * Derive the balanced postings for an event from its deltas. Customer
+ * wallets are liabilities (credited when they grow), loans are assets
+ * (debited when they grow); whatever is left unbalanced in a unit goes
+ * to the event's bank-side counter ledger.
+ */
+int buildPostings(const Event *event, Posting *postings) {
+    int count = 0;
+    int index = event->accountIndex;
+    unsigned long long seq = event->sequence;
+    
+    addPosting(postings, &count, seq, LEDGER_CUSTOMER_WALLET, index, -1, -(double)event->balanceDelta);
+    addPosting(postings, &count, seq, LEDGER_CUSTOMER_LOAN, index, -1, (double)event->loanDelta);
+    if (event->instrument >= 0) {
+        addPosting(postings, &count, seq, LEDGER_CUSTOMER_WALLET, index, event->instrument,
+                   -(double)event->instrumentDelta);
+    }
+    if (event->counterInstrument >= 0) {
+        addPosting(postings, &count, seq, LEDGER_CUSTOMER_WALLET, index, event->counterInstrument,
+                   -(double)event->counterDelta);
+    }
+    
+    // Balance each unit against the counter ledger
+    int customerPostings = count;
+    for (int i = 0; i < customerPostings; i++) {
+        int unit = postings[i].instrument;
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen = seen || postings[j].instrument == unit;
+        }
+        if (seen) {
+            continue;
+        }
+        
+        double net = 0.0;
+        for (int j = 0; j < customerPostings; j++) {
+            if (postings[j].instrument == unit) {
+                net += postings[j].amount;
+            }
+        }
+        addPosting(postings, &count, seq, counterLedger(event->type), -1, unit, -net);
+    }
+    
+    return count;
+}
+
+/**
+ * Append an event's postings to the postings log
+ */
+ErrorCode postEvent(const Event *event) {
+    if (postingsFile == NULL) {
+        return SUCCESS;
+    }
+    
+    Posting postings[MAX_EVENT_POSTINGS];
+    int count = buildPostings(event, postings);
+    if (fwrite(postings, sizeof(Posting), count, postingsFile) != (size_t)count) {
+        return ERROR_FILE_IO;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Post the current state as opening balances against equity, so a postings
+ * log started on existing data reconciles from its first record
+ */
+ErrorCode postOpeningBalances(void) {
+    TRACE_SCOPE("postOpeningBalances");
+    for (int i = 0; i < accountCount; i++) {
+        Event opening = makeEvent(EVENT_ACCOUNT_CREATED, i);
+        opening.sequence = journalSequence;
+        opening.balanceDelta = accounts[i].balance;
+        opening.loanDelta = accounts[i].loan;
+        
+        ErrorCode result = postEvent(&opening);
+        
+        // One synthetic event per held instrument keeps each within the posting limit
+        for (int id = 0; id < instrumentCount && result == SUCCESS; id++) {
+            if (holdings[id][i] != 0.0f) {
+                Event held = makeEvent(EVENT_ACCOUNT_CREATED, i);
+                held.sequence = journalSequence;
+                held.instrument = id;
+                held.instrumentDelta = holdings[id][i];
+                result = postEvent(&held);
+            }
+        }
+        if (result != SUCCESS) {
+            return result;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Reconciliation work for one thread. First it sums its posting range into
+ * its own partial columns (balance, loan, then one per instrument, each
+ * indexed by account) and trial balance; then it adds every thread's
+ * partials for its account range into thread 0's columns.
+ */
+typedef struct {
+    const Posting *postings;
+    size_t firstPosting;
+    size_t endPosting;
+    int firstAccount;
+    int endAccount;
+    double *derived;               // [column * accountCount + account]
+    bool columnUsed[MAX_INSTRUMENTS + 2];     // Columns this thread's postings touched
+    const struct ReconcileTasks *all;
+    double trialBalance[MAX_INSTRUMENTS + 1]; // Per unit, USD last
+} ReconcileTask;
+
+typedef struct ReconcileTasks {
+    ReconcileTask *tasks;
+    int count;
+    int columns;
+} ReconcileTasks;
+
+static void *reconcileScanWorker(void *arg) {
+    TRACE_SCOPE("reconcileScanWorker");
+    ReconcileTask *task = arg;
+    double *balance = task->derived;
+    double *loan = task->derived + accountCount;
+    double *holding = task->derived + 2 * (size_t)accountCount;
+    
+    for (size_t p = task->firstPosting; p < task->endPosting; p++) {
+        const Posting *posting = &task->postings[p];
+        int index = posting->accountIndex;
+        int unit = posting->instrument >= 0 ? posting->instrument : MAX_INSTRUMENTS;
+        task->trialBalance[unit] += posting->amount;
+        
+        if (index < 0 || index >= accountCount) {
+            continue;
+        }
+        if (posting->ledger == LEDGER_CUSTOMER_LOAN) {
+            loan[index] += posting->amount;
+            task->columnUsed[1] = true;
+        } else if (posting->ledger == LEDGER_CUSTOMER_WALLET) {
+            if (posting->instrument < 0) {
+                balance[index] -= posting->amount;
+                task->columnUsed[0] = true;
+            } else if (posting->instrument < instrumentCount) {
+                holding[(size_t)posting->instrument * accountCount + index] -= posting->amount;
+                task->columnUsed[2 + posting->instrument] = true;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *reconcileMergeWorker(void *arg) {
+    TRACE_SCOPE("reconcileMergeWorker");
+    ReconcileTask *task = arg;
+    const ReconcileTasks *all = task->all;
+    double *total = all->tasks[0].derived;
+    
+    for (int column = 0; column < all->columns; column++) {
+        size_t base = (size_t)column * accountCount;
+        for (int t = 1; t < all->count; t++) {
+            const double *partial = all->tasks[t].derived;
+            if (!all->tasks[t].columnUsed[column]) {
+                continue; // Still all zero
+            }
+            for (int i = task->firstAccount; i < task->endAccount; i++) {
+                total[base + i] += partial[base + i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run one worker per task, on the calling thread for task 0 and for any
+ * thread that cannot be started
+ */
+static void runReconcilePhase(ReconcileTasks *all, pthread_t *threads, void *(*worker)(void *)) {
+    for (int t = 1; t < all->count; t++) {
+        if (pthread_create(&threads[t], NULL, worker, &all->tasks[t]) != 0) {
+            worker(&all->tasks[t]); // Fall back to running it here
+            threads[t] = 0;
+        }
+    }
+    worker(&all->tasks[0]);
+    for (int t = 1; t < all->count; t++) {
+        if (threads[t] != 0) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+}
+
+/**
+ * Whether a stored float balance matches its value derived from postings
+ */
+static bool balancesMatch(float stored, double derived) {
+    return fabs((double)stored - derived) <= RECONCILE_TOLERANCE + 1e-6 * fabs(derived);
+}
+
+/**
+ * Recompute every balance, loan and holding from the postings log in
+ * parallel and compare with stored state. Each thread scans its own share
+ * of the postings into private partial sums, then the partials are merged
+ * with threads owning disjoint account ranges, so they never contend.
+ * Returns the number of mismatches (-1 on error).
+ */
+int reconcileLedger(int threadCount) {
+    TRACE_SCOPE("reconcileLedger");
+    if (postingsFile != NULL) {
+        fflush(postingsFile);
+    }
+    
+    int fd = open(POSTINGS_FILE, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    size_t postingCount = (size_t)info.st_size / sizeof(Posting);
+    const Posting *postings = NULL;
+    if (postingCount > 0) {
+        postings = mmap(NULL, postingCount * sizeof(Posting), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (postings == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise((void *)postings, postingCount * sizeof(Posting), POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+    
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    if (threadCount > MAX_RECONCILE_THREADS) {
+        threadCount = MAX_RECONCILE_THREADS;
+    }
+    
+    // Every thread keeps a full set of partial columns, so cap the thread count by memory
+    int columns = 2 + instrumentCount;
+    size_t slots = (size_t)accountCount > 0 ? (size_t)accountCount : 1;
+    long long partialBytes = (long long)(slots * columns * sizeof(double));
+    if ((long long)threadCount * partialBytes > RECONCILE_MEMORY_BUDGET) {
+        threadCount = (int)(RECONCILE_MEMORY_BUDGET / partialBytes);
+        if (threadCount < 1) {
+            threadCount = 1;
+        }
+    }
+    
+    ReconcileTask *tasks = calloc(threadCount, sizeof(ReconcileTask));
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    ReconcileTasks all = {tasks, threadCount, columns};
+    int mismatches = -1;
+    
+    if (tasks == NULL || threads == NULL) {
+        goto cleanup;
+    }
+    for (int t = 0; t < threadCount; t++) {
+        tasks[t].derived = calloc(slots * columns, sizeof(double));
+        if (tasks[t].derived == NULL) {
+            goto cleanup;
+        }
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (int t = 0; t < threadCount; t++) {
+        tasks[t].postings = postings;
+        tasks[t].firstPosting = postingCount * t / threadCount;
+        tasks[t].endPosting = postingCount * (t + 1) / threadCount;
+        tasks[t].firstAccount = (int)((long long)accountCount * t / threadCount);
+        tasks[t].endAccount = (int)((long long)accountCount * (t + 1) / threadCount);
+        tasks[t].all = &all;
+    }
+    runReconcilePhase(&all, threads, reconcileScanWorker);
+    runReconcilePhase(&all, threads, reconcileMergeWorker);
+    
+    const double *derivedBalance = tasks[0].derived;
+    const double *derivedLoan = tasks[0].derived + accountCount;
+    const double *derivedHoldings = tasks[0].derived + 2 * (size_t)accountCount;
+    
+    // Compare derived and stored values
+    mismatches = 0;
+    for (int i = 0; i < accountCount; i++) {
+        bool match = balancesMatch(accounts[i].balance, derivedBalance[i]) &&
+                     balancesMatch(accounts[i].loan, derivedLoan[i]);
+        int holding = -1; // First instrument whose holding disagrees
+        for (int id = 0; id < instrumentCount && holding < 0; id++) {
+            if (!balancesMatch(holdings[id][i], derivedHoldings[(size_t)id * accountCount + i])) {
+                holding = id;
+            }
+        }
+        
+        if (!match || holding >= 0) {
+            if (mismatches < 10) {
+                printf("[MISMATCH] %-20s stored $%.2f / loan $%.2f, postings $%.2f / loan $%.2f",
+                       accounts[i].name, accounts[i].balance, accounts[i].loan,
+                       derivedBalance[i], derivedLoan[i]);
+                if (holding >= 0) {
+                    printf("; %s stored %.4f, postings %.4f", instruments[holding].code, holdings[holding][i],
+                           derivedHoldings[(size_t)holding * accountCount + i]);
+                }
+                printf("\n");
+            }
+            mismatches++;
+        }
+    }
+    
+    // Every unit's postings must sum to zero across the whole ledger
+    for (int unit = 0; unit <= MAX_INSTRUMENTS; unit++) {
+        double total = 0.0;
+        for (int t = 0; t < threadCount; t++) {
+            total += tasks[t].trialBalance[unit];
+        }
+        if (fabs(total) > RECONCILE_TOLERANCE) {
+            printf("[MISMATCH] Trial balance for %s is off by %.4f\n",
+                   unit == MAX_INSTRUMENTS ? BASE_CURRENCY_CODE : instruments[unit].code, total);
+            mismatches++;
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("[INFO] Reconciled %d account(s) against %zu posting(s) on %d thread(s) in %.1f ms.\n",
+           accountCount, postingCount, threadCount,
+           (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    
+cleanup:
+    if (postings != NULL) {
+        munmap((void *)postings, postingCount * sizeof(Posting));
+    }
+    for (int t = 0; tasks != NULL && t < threadCount; t++) {
+        free(tasks[t].derived);
+    }
+    free(tasks);
+    free(threads);
+    return mismatches;
+}
+
+// ==================== EVENT JOURNAL ====================
+
+/**
+ * Current wall-clock time in microseconds since the epoch
+ */
+long long currentTimeMicros(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Initialize a new account record; the opening balance arrives with the
+ * creation event
+ */
+void initializeAccount(int index, const char *name, int pin) {
+    Account *account = &accounts[index];
+    
+    strncpy(account->name, name, MAX_NAME_LENGTH - 1);
+    account->name[MAX_NAME_LENGTH - 1] = '\0';
+    account->pin = pin;
+    account->balance = 0.0f;
+    account->loan = 0.0f;
+    account->lastEventOffset = -1;
+    
+    for (int i = 0; i < instrumentCount; i++) {
+        holdings[i][index] = 0.0f;
+    }
+}
+
+/**
+ * Apply an event's deltas to in-memory state (shared by live operations and replay)
+ */
+bool applyEvent(const Event *event) {
+    int index = event->accountIndex;
+    if (index < 0 || (event->type == EVENT_ACCOUNT_CREATED && !ensureAccountCapacity(index + 1)) ||
+        index >= accountCapacity || event->instrument >= instrumentCount || event->counterInstrument >= instrumentCount) {
+        return false;
+    }
+    
+    if (event->type == EVENT_ACCOUNT_CREATED) {
+        initializeAccount(index, event->name, event->pin);
+        if (index >= accountCount) {
+            accountCount = index + 1;
+        }
+    } else if (index >= accountCount) {
+        return false;
+    }
+    
+    accounts[index].balance += event->balanceDelta;
+    accounts[index].loan += event->loanDelta;
+    if (event->instrument >= 0) {
+        holdings[event->instrument][index] += event->instrumentDelta;
+    }
+    if (event->counterInstrument >= 0) {
+        holdings[event->counterInstrument][index] += event->counterDelta;
+    }
+    
+    accounts[index].lastEventOffset = (long)(event->sequence * sizeof(Event));
+    merkleUpdate(&stateTree, index);
+    return true;
+}
+
+/**
+ * Append a checkpoint of the current state and index it
+ */
+ErrorCode writeCheckpoint(long long timestamp) {
+    TRACE_SCOPE("writeCheckpoint");
+    ALLOC_SCOPE(ALLOC_JOURNAL);
+    if (checkpointFile == NULL) {
+        checkpointFile = fopen(CHECKPOINT_FILE, "ab");
+    }
+    if (checkpointIndexFile == NULL) {
+        checkpointIndexFile = fopen(JOURNAL_INDEX_FILE, "ab");
+    }
+    if (checkpointFile == NULL || checkpointIndexFile == NULL) {
+        return ERROR_FILE_IO;
+    }
+    
+    fseek(checkpointFile, 0, SEEK_END);
+    JournalIndexEntry entry;
+    entry.sequence = journalSequence;
+    entry.timestamp = timestamp;
+    entry.journalOffset = (long)(journalSequence * sizeof(Event));
+    entry.checkpointOffset = ftell(checkpointFile);
+    
+    // Readers open these files separately, so flush before indexing the checkpoint
+    if (!writeSnapshot(checkpointFile) || fflush(checkpointFile) != 0) {
+        return ERROR_FILE_IO;
+    }
+    bool written = fwrite(&entry, sizeof(entry), 1, checkpointIndexFile) == 1;
+    written = fflush(checkpointIndexFile) == 0 && written;
+    
+    return written ? SUCCESS : ERROR_FILE_IO;
+}
+
+/**
+ * Check an event against current state: it may not overdraw cash, loan or
+ * holdings, and a new account takes the next free slot. Runs under the
+ * store lock so checks and updates from other processes cannot interleave.
+ */
+ErrorCode validateEvent(Event *event) {
+    if (event->type == EVENT_ACCOUNT_CREATED) {
+        if (!ensureAccountCapacity(accountCount + 1)) {
+            return ERROR_INVALID_INPUT;
+        }
+        if (accountExists(event->name, event->pin)) {
+            return ERROR_ACCOUNT_EXISTS;
+        }
+        event->accountIndex = accountCount;
+        return SUCCESS;
+    }
+    
+    int index = event->accountIndex;
+    if (index < 0 || index >= accountCount) {
+        return ERROR_INVALID_INPUT;
+    }
+    
+    if (accounts[index].balance + event->balanceDelta < 0.0f ||
+        (event->instrument >= 0 && holdings[event->instrument][index] + event->instrumentDelta < 0.0f) ||
+        (event->counterInstrument >= 0 &&
+         holdings[event->counterInstrument][index] + event->counterDelta < 0.0f)) {
+        return ERROR_INSUFFICIENT_FUNDS;
+    }
+    if (accounts[index].loan + event->loanDelta < 0.0f) {
+        return ERROR_INVALID_INPUT;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Validate an event, write it ahead to the journal, then apply it. Every
+ * CHECKPOINT_INTERVAL events (more for large tables) a checkpoint is taken
+ * so replays stay short.
+ */
+static ErrorCode commitEventImpl(Event *event) {
+    lockStore();
+    
+    ErrorCode result = validateEvent(event);
+    if (result != SUCCESS) {
+        unlockStore();
+        return result;
+    }
+    
+    event->sequence = journalSequence;
+    event->timestamp = currentTimeMicros();
+    event->previousOffset = event->type == EVENT_ACCOUNT_CREATED
+                                ? -1 : accounts[event->accountIndex].lastEventOffset;
+    
+    // The event counts as committed only once its journal record, its
+    // postings and the state change all went through; otherwise both logs
+    // are cut back so replay and followers never see it. Earlier events
+    // are flushed first, so the buffers then hold nothing but this event.
+    if ((journalFile != NULL && fflush(journalFile) != 0) ||
+        (postingsFile != NULL && fflush(postingsFile) != 0)) {
+        unlockStore();
+        return ERROR_FILE_IO;
+    }
+    long journalOffset = journalFile != NULL ? ftell(journalFile) : 0;
+    long postingsOffset = postingsFile != NULL ? ftell(postingsFile) : 0;
+    if (journalFile != NULL && fwrite(event, sizeof(Event), 1, journalFile) != 1) {
+        result = ERROR_FILE_IO;
+    }
+    if (result == SUCCESS) {
+        result = postEvent(event);
+    }
+    if (result == SUCCESS && !applyEvent(event)) {
+        result = ERROR_INVALID_INPUT; // Rejected before any state was touched
+    }
+    if (result != SUCCESS) {
+        truncateRecordLog(journalFile, journalOffset);
+        truncateRecordLog(postingsFile, postingsOffset);
+        unlockStore();
+        return result;
+    }
+    journalSequence++;
+    
+    // A checkpoint copies every account, so space them at least one event per account apart
+    unsigned long long interval = CHECKPOINT_INTERVAL * (1 + (unsigned long long)accountCount / CHECKPOINT_INTERVAL);
+    if (result == SUCCESS && journalFile != NULL && journalSequence % interval == 0) {
+        fflush(journalFile);
+        result = writeCheckpoint(event->timestamp);
+    }
+    
+    unlockStore();
+    return result;
+}
+
+/**
+ * commitEventImpl(), counted by event type and outcome
+ */
+ErrorCode commitEvent(Event *event) {
+    ErrorCode result = commitEventImpl(event);
+    metricEvent(event->type, result);
+    LOG_EVENT(LOG_EVENT_COMMITTED, event->type, event->accountIndex, result, CENTS(event->amount));
+    return result;
+}
+
+/**
+ * Apply journal events committed after the loaded snapshot was saved, so
+ * transactions acknowledged before a crash survive an unsaved state file.
+ * Returns the number of events replayed, or -1 if the journal is unreadable.
+ */
+long replayJournalTail(unsigned long long fromSequence) {
+    TRACE_SCOPE("replayJournalTail");
+    FILE *journal = fopen(JOURNAL_FILE, "rb");
+    if (journal == NULL || fseek(journal, (long)(fromSequence * sizeof(Event)), SEEK_SET) != 0) {
+        if (journal != NULL) {
+            fclose(journal);
+        }
+        return -1;
+    }
+    
+    long replayed = 0;
+    Event event;
+    while (fromSequence + (unsigned long long)replayed < journalSequence &&
+           fread(&event, sizeof(event), 1, journal) == 1) {
+        if (!applyEvent(&event)) {
+            break;
+        }
+        replayed++;
+    }
+    fclose(journal);
+    return replayed;
+}
+
+/**
+ * Open the journal and postings log for appending. State loaded from a
+ * snapshot taken at `stateSequence` is first brought up to the end of the
+ * journal (SNAPSHOT_SEQUENCE_UNKNOWN skips this). A first checkpoint is
+ * taken so history can always be rebuilt from the start, and a fresh
+ * postings log opens with the current balances.
+ */
+ErrorCode openJournal(unsigned long long stateSequence) {
+    TRACE_SCOPE("openJournal");
+    ALLOC_SCOPE(ALLOC_JOURNAL);
+    journalFile = openRecordLog(JOURNAL_FILE, sizeof(Event), &journalSequence);
+    if (journalFile == NULL) {
+        return ERROR_FILE_IO;
+    }
+    
+    if (stateSequence != SNAPSHOT_SEQUENCE_UNKNOWN && stateSequence < journalSequence) {
+        long replayed = replayJournalTail(stateSequence);
+        if (replayed < 0 || stateSequence + (unsigned long long)replayed != journalSequence) {
+            printf("\n[WARNING] Replayed only %ld of %llu journal event(s) newer than %s.\n",
+                   replayed < 0 ? 0 : replayed, journalSequence - stateSequence, DATA_FILE);
+        } else {
+            printf("\n[INFO] Replayed %ld journal event(s) newer than %s.\n", replayed, DATA_FILE);
+        }
+        if (replayed > 0 && saveAccounts() != SUCCESS) {
+            printf("\n[WARNING] Could not save the replayed state to %s.\n", DATA_FILE);
+        }
+    }
+    
+    unsigned long long postingCount;
+    postingsFile = openRecordLog(POSTINGS_FILE, sizeof(Posting), &postingCount);
+    if (postingsFile == NULL) {
+        return ERROR_FILE_IO;
+    }
+    if (postingCount == 0) {
+        ErrorCode result = postOpeningBalances();
+        if (result != SUCCESS) {
+            return result;
+        }
+    }
+    
+    FILE *index = fopen(JOURNAL_INDEX_FILE, "rb");
+    if (index != NULL) {
+        fseek(index, 0, SEEK_END);
+        bool hasCheckpoint = ftell(index) >= (long)sizeof(JournalIndexEntry);
+        fclose(index);
+        if (hasCheckpoint) {
+            return SUCCESS;
+        }
+    }
+    return writeCheckpoint(currentTimeMicros());
+}
+
+/**
+ * Close the account file and every log stream. The next save or
+ * openJournal() reopens them relative to the current directory.
+ */
+void closeStateFiles(void) {
+    FILE **streams[] = {&dataFile, &journalFile, &postingsFile, &checkpointFile, &checkpointIndexFile};
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+        if (*streams[i] != NULL) {
+            fclose(*streams[i]);
+            *streams[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Create a scratch directory from a mkdtemp() template and move into it.
+ * Returns a descriptor of the previous working directory for
+ * removeScratchDirectory(), or -1 with the working directory unchanged.
+ */
+int enterScratchDirectory(char *directory) {
+    int previous = open(".", O_RDONLY | O_DIRECTORY);
+    if (previous < 0) {
+        return -1;
+    }
+    if (mkdtemp(directory) == NULL) {
+        close(previous);
+        return -1;
+    }
+    if (chdir(directory) != 0) {
+        rmdir(directory);
+        close(previous);
+        return -1;
+    }
+    return previous;
+}
+
+/**
+ * Close the state files, delete them along with the scratch directory
+ * they were written to, and return to the previous working directory so
+ * relative paths given at startup (trace, log) still resolve
+ */
+void removeScratchDirectory(const char *directory, int previous) {
+    static const char *const scratchFiles[] = {
+        DATA_FILE, JOURNAL_FILE, POSTINGS_FILE, CHECKPOINT_FILE, JOURNAL_INDEX_FILE
+    };
+    closeStateFiles();
+    for (size_t i = 0; i < sizeof(scratchFiles) / sizeof(scratchFiles[0]); i++) {
+        unlink(scratchFiles[i]);
+    }
+    rmdir(directory);
+    if (fchdir(previous) != 0) {
+        printf("\n[WARNING] Could not return to the previous working directory.\n");
+    }
+    close(previous);
+}
+
+/**
+ * Find the newest checkpoint taken at or before a point in time
+ */
+ErrorCode findCheckpoint(long long timestamp, JournalIndexEntry *found) {
+    FILE *index = fopen(JOURNAL_INDEX_FILE, "rb");
+    if (index == NULL) {
+        return ERROR_FILE_IO;
+    }
+    
+    // Binary search for the last checkpoint not after the target time
+    fseek(index, 0, SEEK_END);
+    long low = 0;
+    long high = ftell(index) / (long)sizeof(JournalIndexEntry) - 1;
+    JournalIndexEntry entry;
+    bool haveCheckpoint = false;
+    
+    while (low <= high) {
+        long mid = low + (high - low) / 2;
+        fseek(index, mid * (long)sizeof(JournalIndexEntry), SEEK_SET);
+        if (fread(&entry, sizeof(entry), 1, index) != 1) {
+            fclose(index);
+            return ERROR_FILE_IO;
+        }
+        
+        if (entry.timestamp <= timestamp) {
+            *found = entry;
+            haveCheckpoint = true;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    fclose(index);
+    
+    return haveCheckpoint ? SUCCESS : ERROR_INVALID_INPUT; // No history that far back
+}
+
+/**
+ * Load a checkpoint's snapshot into memory
+ */
+ErrorCode restoreCheckpoint(const JournalIndexEntry *entry) {
+    FILE *checkpoint = fopen(CHECKPOINT_FILE, "rb");
+    if (checkpoint == NULL) {
+        return ERROR_FILE_IO;
+    }
+    fseek(checkpoint, entry->checkpointOffset, SEEK_SET);
+    bool restored = readSnapshot(checkpoint);
+    fclose(checkpoint);
+    return restored ? SUCCESS : ERROR_FILE_IO;
+}
+
+/**
+ * Rebuild in-memory state as of a point in time: restore the newest
+ * checkpoint taken at or before it, then replay later events up to it.
+ */
+ErrorCode reconstructStateAt(long long timestamp) {
+    TRACE_SCOPE("reconstructStateAt");
+    JournalIndexEntry found;
+    ErrorCode result = findCheckpoint(timestamp, &found);
+    if (result == SUCCESS) {
+        result = restoreCheckpoint(&found);
+    }
+    if (result != SUCCESS) {
+        return result;
+    }
+    
+    // Replay events recorded after it, up to the target time
+    FILE *journal = fopen(JOURNAL_FILE, "rb");
+    if (journal == NULL) {
+        return ERROR_FILE_IO;
+    }
+    fseek(journal, found.journalOffset, SEEK_SET);
+    
+    Event event;
+    while (fread(&event, sizeof(event), 1, journal) == 1 && event.timestamp <= timestamp) {
+        applyEvent(&event);
+    }
+    fclose(journal);
+    
+    return SUCCESS;
+}
+
+/**
+ * Bring the shared store back to what was last published after a process
+ * died holding its lock. Records past the published journal sequence and
+ * postings length are cut off, checkpoints of unpublished state are
+ * dropped from the index, and accounts, holdings and the hash tree are
+ * rebuilt from the newest remaining checkpoint plus the journal after it.
+ * Runs with the store lock held.
+ */
+bool recoverSharedStore(void) {
+    TRACE_SCOPE("recoverSharedStore");
+    unsigned long long committed = sharedStore->journalSequence;
+    
+    // Journal tail: nothing past the published sequence, and nothing missing before it
+    struct stat info;
+    long journalLength = (long)(committed * sizeof(Event));
+    if (stat(JOURNAL_FILE, &info) != 0 || info.st_size < journalLength ||
+        (info.st_size > journalLength && truncate(JOURNAL_FILE, journalLength) != 0)) {
+        return false;
+    }
+    if (sharedStore->postingsLength > 0 && stat(POSTINGS_FILE, &info) == 0 &&
+        info.st_size > sharedStore->postingsLength && truncate(POSTINGS_FILE, sharedStore->postingsLength) != 0) {
+        return false;
+    }
+    
+    // Newest checkpoint of published state; later ones are dropped
+    FILE *index = fopen(JOURNAL_INDEX_FILE, "rb");
+    if (index == NULL) {
+        return false;
+    }
+    JournalIndexEntry entry, found;
+    long kept = 0;
+    while (fread(&entry, sizeof(entry), 1, index) == 1 && entry.sequence <= committed) {
+        found = entry;
+        kept++;
+    }
+    fclose(index);
+    if (kept == 0 || truncate(JOURNAL_INDEX_FILE, kept * (long)sizeof(JournalIndexEntry)) != 0 ||
+        restoreCheckpoint(&found) != SUCCESS) {
+        return false;
+    }
+    
+    journalSequence = committed;
+    long replayed = replayJournalTail(found.sequence);
+    if (replayed < 0 || found.sequence + (unsigned long long)replayed != committed) {
+        return false;
+    }
+    sharedStore->accountCount = accountCount;
+    printf("[INFO] Shared store rebuilt from checkpoint %llu and %ld journal event(s).\n",
+           found.sequence, replayed);
+    return true;
+}
+
+/**
+ * Read the next page of an account's history, newest first, by following
+ * the per-account chain of previous-event offsets. Start with *cursor set to
+ * the account's lastEventOffset; it is -1 once the oldest event was read.
+ */
+int readAccountHistory(long *cursor, Event *page, int maxEvents) {
+    if (*cursor < 0) {
+        return 0;
+    }
+    if (journalFile != NULL) {
+        fflush(journalFile);
+    }
+    
+    FILE *journal = fopen(JOURNAL_FILE, "rb");
+    if (journal == NULL) {
+        return 0;
+    }
+    
+    int count = 0;
+    while (count < maxEvents && *cursor >= 0) {
+        if (fseek(journal, *cursor, SEEK_SET) != 0 ||
+            fread(&page[count], sizeof(Event), 1, journal) != 1) {
+            *cursor = -1;
+            break;
+        }
+        *cursor = page[count].previousOffset;
+        count++;
+    }
+    
+    fclose(journal);
+    return count;
+}
+
+/**
+ * Human-readable name of an event type
+ */
+const char *eventTypeName(int type) {
+    switch (type) {
+        case EVENT_ACCOUNT_CREATED:     return "Account opened";
+        case EVENT_DEPOSIT:             return "Deposit";
+        case EVENT_WITHDRAWAL:          return "Withdrawal";
+        case EVENT_ASSET_PURCHASE:      return "Asset purchase";
+        case EVENT_LOAN_TAKEN:          return "Loan taken";
+        case EVENT_LOAN_REPAID:         return "Loan repaid";
+        case EVENT_INTEREST:            return "Interest";
+        case EVENT_CURRENCY_CONVERSION: return "Currency conversion";
+        default:                        return "Unknown";
+    }
+}
+
+/**
+ * Print a one-line summary of an account and its non-zero holdings
+ */
+void printAccountSummary(int index) {
+    printf("%-20s balance $%12.2f  loan $%10.2f", accounts[index].name,
+           accounts[index].balance, accounts[index].loan);
+    for (int i = 0; i < instrumentCount; i++) {
+        if (holdings[i][index] != 0.0f) {
+            printf("  %s %.4f", instruments[i].code, holdings[i][index]);
+        }
+    }
+    printf("\n");
+}
+
+// ==================== FOREIGN EXCHANGE ====================
+
+/**
+ * Three-letter code of a currency slot
+ */
+const char *currencyCode(int slot) {
+    return slot == BASE_CURRENCY ? BASE_CURRENCY_CODE : instruments[currencyInstrument[slot]].code;
+}
+
+/**
+ * Look up a currency slot by its code (-1 if not a listed currency)
+ */
+int findCurrency(const char *code) {
+    if (strcmp(code, BASE_CURRENCY_CODE) == 0) {
+        return BASE_CURRENCY;
+    }
+    int id = findInstrument(code);
+    return id >= 0 ? instrumentCurrency[id] : -1;
+}
+
+/**
+ * USD value of one unit of a currency slot
+ */
+float currencyQuote(int slot) {
+    return slot == BASE_CURRENCY ? 1.0f : instrumentPrices[currencyInstrument[slot]];
+}
+
+/**
+ * Conversion rate between two currency slots (units of 'to' per unit of 'from').
+ * Direct quotes win; other cross rates are triangulated through USD. Either
+ * way the result is served from the cache until either currency's quote changes.
+ */
+float exchangeRate(int from, int to) {
+    CrossRate *entry = &crossRates[from][to];
+    
+    if (entry->fromEpoch != currencyEpoch[from] || entry->toEpoch != currencyEpoch[to]) {
+        if (from == to) {
+            entry->rate = 1.0f;
+        } else if (directRates[from][to] > 0) {
+            entry->rate = directRates[from][to];
+        } else {
+            entry->rate = currencyQuote(from) / currencyQuote(to);
+        }
+        entry->fromEpoch = currencyEpoch[from];
+        entry->toEpoch = currencyEpoch[to];
+    }
+    
+    return entry->rate;
+}
+
+/**
+ * Pointer to an account's balance in a currency slot (USD is the cash balance)
+ */
+float *walletBalance(int accountIndex, int slot) {
+    if (slot == BASE_CURRENCY) {
+        return &accounts[accountIndex].balance;
+    }
+    return &holdings[currencyInstrument[slot]][accountIndex];
+}
+
+/**
+ * Add a currency leg to an event: USD moves the cash balance, other
+ * currencies take the first free instrument leg
+ */
+void addWalletLeg(Event *event, int slot, float delta) {
+    if (slot == BASE_CURRENCY) {
+        event->balanceDelta += delta;
+    } else if (event->instrument < 0) {
+        event->instrument = currencyInstrument[slot];
+        event->instrumentDelta = delta;
+    } else {
+        event->counterInstrument = currencyInstrument[slot];
+        event->counterDelta = delta;
+    }
+}
+
+/**
+ * Convert an amount between two currencies in an account's wallet
+ */
+ErrorCode convertCurrency(int accountIndex, int from, int to, float amount, float *received) {
+    if (from < 0 || from >= currencyCount || to < 0 || to >= currencyCount ||
+        from == to || amount <= 0) {
+        return ERROR_INVALID_INPUT;
+    }
+    
+    if (blockedPairs[from][to]) {
+        return ERROR_RATE_BLOCKED;
+    }
+    
+    float *source = walletBalance(accountIndex, from);
+    if (amount > *source) {
+        return ERROR_INSUFFICIENT_FUNDS;
+    }
+    
+    float converted = amount * exchangeRate(from, to);
+    Event event = makeEvent(EVENT_CURRENCY_CONVERSION, accountIndex);
+    event.amount = amount;
+    addWalletLeg(&event, from, -amount);
+    addWalletLeg(&event, to, converted);
+    
+    ErrorCode result = commitEvent(&event);
+    if (result == SUCCESS && received != NULL) {
+        *received = converted;
+    }
+    return result;
+}
+
+/**
+ * Set or replace a direct quote for a currency pair
+ */
+bool setDirectQuote(int from, int to, float rate) {
+    if (from < 0 || from >= currencyCount || to < 0 || to >= currencyCount ||
+        from == to || rate <= 0) {
+        return false;
+    }
+    
+    if (directRates[from][to] <= 0) {
+        if (directQuoteCount >= MAX_DIRECT_QUOTES) {
+            return false;
+        }
+        directQuotes[directQuoteCount++] = (DirectQuote){from, to, rate};
+    } else {
+        for (int i = 0; i < directQuoteCount; i++) {
+            if (directQuotes[i].from == from && directQuotes[i].to == to) {
+                directQuotes[i].rate = rate;
+                break;
+            }
+        }
+    }
+    
+    directRates[from][to] = rate;
+    crossRates[from][to].fromEpoch = 0; // Force the cache entry to refresh
+    return true;
+}
+
+static const double *arbitrageSortKeys;
+
+static int compareByArbitrageKey(const void *a, const void *b) {
+    double da = arbitrageSortKeys[*(const int *)a];
+    double db = arbitrageSortKeys[*(const int *)b];
+    return (da > db) - (da < db);
+}
+
+/**
+ * Return a vertex on a cycle of the predecessor graph (-1 if it is acyclic).
+ * During Bellman-Ford any such cycle is a negative cycle.
+ */
+static int findPredecessorCycle(const int *pred, int n) {
+    static int visitedBy[MAX_CURRENCIES];
+    
+    for (int v = 0; v < n; v++) {
+        visitedBy[v] = -1;
+    }
+    
+    for (int root = 0; root < n; root++) {
+        int v = root;
+        while (v >= 0 && visitedBy[v] < 0) {
+            visitedBy[v] = root;
+            v = pred[v];
+        }
+        if (v >= 0 && visitedBy[v] == root) {
+            return v; // Walk from this root closed on itself
+        }
+    }
+    return -1;
+}
+
+/**
+ * Run Bellman-Ford once over the log-rate graph and return a vertex on a
+ * negative cycle (-1 if none). Weights are re-based on the USD quotes, so
+ * every triangulated edge weighs exactly zero and only direct quotes carry
+ * weight; each pass is then O(n log n + quotes) instead of O(n^2). The
+ * predecessor graph is checked after every pass so cycles are reported as
+ * soon as they form rather than after n passes.
+ */
+static int findNegativeCycle(const double *logQuotes, int *pred) {
+    static double dist[MAX_CURRENCIES];
+    static double next[MAX_CURRENCIES];
+    static int order[MAX_CURRENCIES];
+    int n = currencyCount;
+    int relaxedVertex = -1;
+    
+    for (int v = 0; v < n; v++) {
+        dist[v] = 0.0;
+        pred[v] = -1;
+        order[v] = v;
+    }
+    
+    for (int pass = 0; pass < n; pass++) {
+        relaxedVertex = -1;
+        memcpy(next, dist, sizeof(double) * n);
+        
+        // Zero-weight triangulated edges: cheapest predecessor without a direct quote
+        arbitrageSortKeys = dist;
+        qsort(order, n, sizeof(int), compareByArbitrageKey);
+        for (int v = 0; v < n; v++) {
+            for (int k = 0; k < n; k++) {
+                int u = order[k];
+                if (u == v || directRates[u][v] <= 0) {
+                    if (dist[u] < next[v] - ARBITRAGE_TOLERANCE) {
+                        next[v] = dist[u];
+                        pred[v] = u;
+                        relaxedVertex = v;
+                    }
+                    break;
+                }
+            }
+        }
+        
+        // Direct-quote edges that are still tradable
+        for (int i = 0; i < directQuoteCount; i++) {
+            const DirectQuote *q = &directQuotes[i];
+            if (blockedPairs[q->from][q->to]) {
+                continue;
+            }
+            
+            double weight = logQuotes[q->from] - logQuotes[q->to] - log(q->rate);
+            if (fabs(weight) < ARBITRAGE_TOLERANCE) {
+                weight = 0.0;
+            }
+            
+            if (dist[q->from] + weight < next[q->to] - ARBITRAGE_TOLERANCE) {
+                next[q->to] = dist[q->from] + weight;
+                pred[q->to] = q->from;
+                relaxedVertex = q->to;
+            }
+        }
+        
+        if (relaxedVertex < 0) {
+            return -1;
+        }
+        memcpy(dist, next, sizeof(double) * n);
+        
+        int cycleVertex = findPredecessorCycle(pred, n);
+        if (cycleVertex >= 0) {
+            return cycleVertex;
+        }
+    }
+    
+    // Still relaxing after n passes: walk back onto the cycle itself
+    int v = relaxedVertex;
+    for (int i = 0; i < n && v >= 0; i++) {
+        v = pred[v];
+    }
+    return v;
+}
+
+/**
+ * Detect arbitrage cycles after a batch of rate updates and block every
+ * directly quoted pair that takes part in one. Blocks from the previous
+ * check are lifted first, so corrected quotes become tradable again.
+ */
+ArbitrageReport detectArbitrage(void) {
+    static double logQuotes[MAX_CURRENCIES];
+    static int pred[MAX_CURRENCIES];
+    ArbitrageReport report = {0, 0, 0};
+    struct timespec start, end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (int i = 0; i < directQuoteCount; i++) {
+        blockedPairs[directQuotes[i].from][directQuotes[i].to] = false;
+    }
+    for (int v = 0; v < currencyCount; v++) {
+        logQuotes[v] = log(currencyQuote(v));
+    }
+    
+    for (int round = 0; round < MAX_ARBITRAGE_ROUNDS; round++) {
+        int cycleVertex = findNegativeCycle(logQuotes, pred);
+        if (cycleVertex < 0) {
+            break;
+        }
+        report.cyclesFound++;
+        
+        // Block the quoted legs of the cycle; triangulated legs are consistent
+        int blockedBefore = report.pairsBlocked;
+        int v = cycleVertex;
+        for (int i = 0; i < currencyCount; i++) {
+            int u = pred[v];
+            if (u < 0) {
+                break;
+            }
+            if (directRates[u][v] > 0 && !blockedPairs[u][v]) {
+                blockedPairs[u][v] = true;
+                report.pairsBlocked++;
+            }
+            v = u;
+            if (v == cycleVertex) {
+                break;
+            }
+        }
+        
+        if (report.pairsBlocked == blockedBefore) {
+            break; // Nothing left to block on this cycle
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report.elapsedMicros = (end.tv_sec - start.tv_sec) * 1000000L +
+                           (end.tv_nsec - start.tv_nsec) / 1000L;
+    return report;
+}
+
+/**
+ * Apply a batch of direct quotes and re-check the graph for arbitrage
+ */
+ArbitrageReport applyQuoteBatch(const DirectQuote *quotes, int count) {
+    for (int i = 0; i < count; i++) {
+        setDirectQuote(quotes[i].from, quotes[i].to, quotes[i].rate);
+    }
+    return detectArbitrage();
+}
+
+/**
+ * Print the outcome of an arbitrage check when it found anything
+ */
+void reportArbitrage(const ArbitrageReport *report) {
+    if (report->cyclesFound > 0) {
+        printf("\n[WARNING] %d arbitrage cycle(s) in exchange quotes; %d pair(s) blocked (%ld us).\n",
+               report->cyclesFound, report->pairsBlocked, report->elapsedMicros);
+    }
+}
+
+/**
+ * Load direct quotes ("FROM TO RATE" per line) if a quotes file is present
+ */
+ErrorCode loadDirectQuotes(void) {
+    FILE *file = fopen(QUOTES_FILE, "r");
+    if (file == NULL) {
+        return SUCCESS; // Direct quotes are optional
+    }
+    
+    static DirectQuote batch[MAX_DIRECT_QUOTES];
+    int count = 0;
+    char fromCode[INSTRUMENT_CODE_LENGTH], toCode[INSTRUMENT_CODE_LENGTH];
+    float rate;
+    
+    while (count < MAX_DIRECT_QUOTES && fscanf(file, "%7s %7s %f", fromCode, toCode, &rate) == 3) {
+        int from = findCurrency(fromCode);
+        int to = findCurrency(toCode);
+        if (from >= 0 && to >= 0) {
+            batch[count++] = (DirectQuote){from, to, rate};
+        }
+    }
+    fclose(file);
+    
+    ArbitrageReport report = applyQuoteBatch(batch, count);
+    reportArbitrage(&report);
+    return SUCCESS;
+}
+
+// ==================== ACCOUNT MANAGEMENT ====================
+
+/**
+ * Create a new account
+ */
+ErrorCode createAccount(void) {
+    if (accountCount >= (sharedStore != NULL ? SHARED_STORE_CAPACITY : MAX_ACCOUNTS)) {
+        printf("\n[ERROR] Maximum account limit reached.\n");
+        return ERROR_INVALID_INPUT;
+    }
+    
+    char name[MAX_NAME_LENGTH];
+    int pin;
+    
+    // Get and validate name
+    printf("\n=== CREATE NEW ACCOUNT ===\n");
+    while (true) {
+        printf("Enter name (alphabets only): ");
+        if (scanf("%49s", name) != 1) {
+            clearInputBuffer();
+            continue;
+        }
+        clearInputBuffer();
+        
+        if (isAlphaString(name)) {
+            break;
+        }
+        printf("[ERROR] Name must contain only alphabetic characters.\n");
+    }
+    
+    // Get and validate PIN
+    while (true) {
+        if (!getIntInput("Set 4-digit PIN (1000-9999): ", &pin)) {
+            printf("[ERROR] Invalid PIN format.\n");
+            continue;
+        }
+        
+        if (isValidPIN(pin)) {
+            break;
+        }
+        printf("[ERROR] PIN must be between 1000 and 9999.\n");
+    }
+    
+    // Check for duplicates
+    if (accountExists(name, pin)) {
+        return ERROR_ACCOUNT_EXISTS;
+    }
+    
+    // Create and save account
+    Event event = makeEvent(EVENT_ACCOUNT_CREATED, accountCount);
+    snprintf(event.name, sizeof(event.name), "%s", name);
+    event.pin = pin;
+    event.amount = STARTING_BALANCE;
+    event.balanceDelta = STARTING_BALANCE;
+    
+    ErrorCode result = commitEvent(&event);
+    if (result == SUCCESS) {
+        result = saveAccounts();
+    }
+    if (result == SUCCESS) {
+        printf("\n[SUCCESS] Account created successfully!\n");
+        printf("Starting balance: $%.2f\n", STARTING_BALANCE);
+    }
+    
+    return result;
+}
+
+/**
+ * Authenticate user login
+ */
+static ErrorCode loginAccountImpl(void) {
+    char name[MAX_NAME_LENGTH];
+    int pin;
+    
+    printf("\n=== LOGIN ===\n");
+    printf("Enter name: ");
+    if (scanf("%49s", name) != 1) {
+        clearInputBuffer();
+        return ERROR_INVALID_INPUT;
+    }
+    clearInputBuffer();
+    
+    if (!getIntInput("Enter PIN: ", &pin)) {
+        return ERROR_INVALID_INPUT;
+    }
+    
+    // Search for matching account
+    for (int i = 0; i < accountCount; i++) {
+        if (strcmp(accounts[i].name, name) == 0 && accounts[i].pin == pin) {
+            currentUserIndex = i;
+            printf("\n[SUCCESS] Welcome, %s!\n", name);
+            return SUCCESS;
+        }
+    }
+    
+    printf("\n[ERROR] Login failed. Invalid credentials.\n");
+    return ERROR_INVALID_PIN;
+}
+
+/**
+ * loginAccountImpl() between its entry and return probes
+ */
+ErrorCode loginAccount(void) {
+    PROBE0(login__entry);
+    ErrorCode result = loginAccountImpl();
+    PROBE2(login__return, currentUserIndex, result);
+    return result;
+}
+
+/**
+ * Verify PIN for current user
+ */
+bool verifyPIN(void) {
+    int pin;
+    if (!getIntInput("Enter PIN for verification: ", &pin)) {
+        return false;
+    }
+    return (pin == accounts[currentUserIndex].pin);
+}
+
+// ==================== MARKET OPERATIONS ====================
+
+/**
+ * Update market prices with realistic fluctuations
+ */
+void updateMarketPrices(void) {
+    printf("\n=== MARKET UPDATE ===\n");
+    
+    for (int i = 0; i < instrumentCount; i++) {
+        const Instrument *instrument = &instruments[i];
+        if (instrument->changeSpanPct <= 0) {
+            continue; // Fixed-price instrument
+        }
+        
+        float change = ((rand() % instrument->changeSpanPct) + instrument->minChangePct) / 100.0f;
+        setInstrumentPrice(i, instrumentPrices[i] * (1.0f + change));
+        
+        printf("%-15s $%.2f (%.2f%%)\n", instrument->name, instrumentPrices[i], change * 100);
+    }
+    
+    // Moved quotes can leave direct quotes inconsistent
+    ArbitrageReport report = detectArbitrage();
+    reportArbitrage(&report);
+}
+
+/**
+ * Display current market prices
+ */
+void displayMarketPrices(void) {
+    printf("\n=== CURRENT MARKET PRICES ===\n");
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == INSTRUMENT_ASSET) {
+            printf("%-15s $%.2f per unit\n", instruments[i].name, instrumentPrices[i]);
+        }
+    }
+    printf("============================\n");
+}
+
+// ==================== BANKING OPERATIONS ====================
+
+/**
+ * Handle cash deposit
+ */
+static ErrorCode depositCashImpl(float amount) {
+    if (amount <= 0) {
+        return ERROR_INVALID_INPUT;
+    }
+    
+    Event event = makeEvent(EVENT_DEPOSIT, currentUserIndex);
+    event.amount = amount;
+    event.balanceDelta = amount;
+    
+    ErrorCode result = commitEvent(&event);
+    if (result != SUCCESS) {
+        return result;
+    }
+    
+    printf("\n[SUCCESS] Deposited $%.2f\n", amount);
+    printf("New balance: $%.2f\n", accounts[currentUserIndex].balance);
+    
+    return saveAccounts();
+}
+
+/**
+ * depositCashImpl() between its entry and return probes
+ */
+ErrorCode depositCash(float amount) {
+    ALLOC_OPERATION(OP_DEPOSIT);
+    PROBE2(deposit__entry, currentUserIndex, CENTS(amount));
+    ErrorCode result = depositCashImpl(amount);
+    PROBE3(deposit__return, currentUserIndex, CENTS(amount), result);
+    return result;
+}
+
+/**
+ * Handle cash withdrawal
+ */
+static ErrorCode withdrawCashImpl(float amount) {
+    if (amount <= 0) {
+        return ERROR_INVALID_INPUT;
+    }
+    
+    if (amount > accounts[currentUserIndex].balance) {
+        return ERROR_INSUFFICIENT_FUNDS;
+    }
+    
+    if (!verifyPIN()) {
+        return ERROR_INVALID_PIN;
+    }
+    
+    Event event = makeEvent(EVENT_WITHDRAWAL, currentUserIndex);
+    event.amount = amount;
+    event.balanceDelta = -amount;
+    
+    ErrorCode result = commitEvent(&event);
+    if (result != SUCCESS) {
+        return result;
+    }
+    
+    printf("\n[SUCCESS] Withdrawn $%.2f\n", amount);
+    printf("New balance: $%.2f\n", accounts[currentUserIndex].balance);
+    
+    return saveAccounts();
+}
+
+/**
+ * withdrawCashImpl() between its entry and return probes
+ */
+ErrorCode withdrawCash(float amount) {
+    ALLOC_OPERATION(OP_WITHDRAW);
+    PROBE2(withdraw__entry, currentUserIndex, CENTS(amount));
+    ErrorCode result = withdrawCashImpl(amount);
+    PROBE3(withdraw__return, currentUserIndex, CENTS(amount), result);
+    return result;
+}
+
+/**
+ * Process cash transactions (deposit/withdraw)
+ */
+void processCashTransaction(void) {
+    int choice;
+    float amount;
+    
+    printf("\n=== CASH TRANSACTION ===\n");
+    printf("1. Deposit\n");
+    printf("2. Withdraw\n");
+    
+    if (!getIntInput("Choice: ", &choice)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    if (!getFloatInput("Enter amount: $", &amount)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    ErrorCode result;
+    if (choice == 1) {
+        result = depositCash(amount);
+    } else if (choice == 2) {
+        result = withdrawCash(amount);
+    } else {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    if (result != SUCCESS) {
+        displayError(result);
+    }
+}
+
+/**
+ * Purchase assets (crypto, gold, silver)
+ */
+static void purchaseAssetImpl(void) {
+    Account *user = &accounts[currentUserIndex];
+    
+    if (user->balance < ASSET_PURCHASE_AMOUNT) {
+        displayError(ERROR_INSUFFICIENT_FUNDS);
+        return;
+    }
+    
+    if (!verifyPIN()) {
+        displayError(ERROR_INVALID_PIN);
+        return;
+    }
+    
+    printf("\n=== PURCHASE ASSET ===\n");
+    printf("Investment amount: $%.2f\n\n", ASSET_PURCHASE_AMOUNT);
+    
+    int option = 0;
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == INSTRUMENT_ASSET) {
+            printf("%d. %-15s ($%.2f/unit)\n", ++option, instruments[i].name, instrumentPrices[i]);
+        }
+    }
+    
+    int choice;
+    if (!getIntInput("\nChoice: ", &choice)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    int id = instrumentByMenuChoice(INSTRUMENT_ASSET, choice);
+    if (id < 0) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    float units = ASSET_PURCHASE_AMOUNT / instrumentPrices[id];
+    Event event = makeEvent(EVENT_ASSET_PURCHASE, currentUserIndex);
+    event.amount = ASSET_PURCHASE_AMOUNT;
+    event.balanceDelta = -ASSET_PURCHASE_AMOUNT;
+    event.instrument = id;
+    event.instrumentDelta = units;
+    
+    ErrorCode result = commitEvent(&event);
+    if (result != SUCCESS) {
+        displayError(result);
+        return;
+    }
+    printf("\n[SUCCESS] Purchased %.4f units of %s\n", units, instruments[id].name);
+    
+    printf("Remaining balance: $%.2f\n", user->balance);
+    saveAccounts();
+}
+
+/**
+ * purchaseAssetImpl() between its entry and return probes
+ */
+void purchaseAsset(void) {
+    ALLOC_OPERATION(OP_PURCHASE);
+    float before = accounts[currentUserIndex].balance;
+    PROBE2(purchase__entry, currentUserIndex, CENTS(before));
+    purchaseAssetImpl();
+    PROBE2(purchase__return, currentUserIndex, CENTS(accounts[currentUserIndex].balance - before));
+}
+
+/**
+ * Manage loan (take or repay)
+ */
+static void manageLoanImpl(void) {
+    Account *user = &accounts[currentUserIndex];
+    
+    if (!verifyPIN()) {
+        displayError(ERROR_INVALID_PIN);
+        return;
+    }
+    
+    printf("\n=== LOAN MANAGEMENT ===\n");
+    
+    if (user->loan == 0) {
+        printf("You have no outstanding loan.\n");
+        printf("Would you like to take a loan of $%.2f? (1=Yes, 0=No): ", LOAN_AMOUNT);
+        
+        int confirm;
+        if (!getIntInput("", &confirm) || confirm != 1) {
+            printf("Loan request cancelled.\n");
+            return;
+        }
+        
+        Event event = makeEvent(EVENT_LOAN_TAKEN, currentUserIndex);
+        event.amount = LOAN_AMOUNT;
+        event.balanceDelta = LOAN_AMOUNT;
+        event.loanDelta = LOAN_AMOUNT;
+        
+        ErrorCode result = commitEvent(&event);
+        if (result != SUCCESS) {
+            displayError(result);
+            return;
+        }
+        printf("\n[SUCCESS] Loan of $%.2f approved!\n", LOAN_AMOUNT);
+        printf("New balance: $%.2f\n", user->balance);
+    } else {
+        printf("Outstanding loan: $%.2f\n", user->loan);
+        printf("Current balance: $%.2f\n", user->balance);
+        
+        if (user->balance >= user->loan) {
+            printf("Repay full loan? (1=Yes, 0=No): ");
+            
+            int confirm;
+            if (!getIntInput("", &confirm) || confirm != 1) {
+                printf("Repayment cancelled.\n");
+                return;
+            }
+            
+            Event event = makeEvent(EVENT_LOAN_REPAID, currentUserIndex);
+            event.amount = user->loan;
+            event.balanceDelta = -user->loan;
+            event.loanDelta = -user->loan;
+            
+            ErrorCode result = commitEvent(&event);
+            if (result != SUCCESS) {
+                displayError(result);
+                return;
+            }
+            printf("\n[SUCCESS] Loan fully repaid!\n");
+            printf("Remaining balance: $%.2f\n", user->balance);
+        } else {
+            printf("\n[INFO] Insufficient funds to repay loan.\n");
+            return;
+        }
+    }
+    
+    saveAccounts();
+}
+
+/**
+ * manageLoanImpl() between its entry and return probes
+ */
+void manageLoan(void) {
+    float before = accounts[currentUserIndex].loan;
+    PROBE2(loan__entry, currentUserIndex, CENTS(before));
+    manageLoanImpl();
+    PROBE2(loan__return, currentUserIndex, CENTS(accounts[currentUserIndex].loan - before));
+}
+
+/**
+ * Add interest to account balance
+ */
+static void addInterestImpl(void) {
+    Account *user = &accounts[currentUserIndex];
+    float interest = user->balance * INTEREST_RATE;
+    
+    Event event = makeEvent(EVENT_INTEREST, currentUserIndex);
+    event.amount = interest;
+    event.balanceDelta = interest;
+    
+    ErrorCode result = commitEvent(&event);
+    if (result != SUCCESS) {
+        displayError(result);
+        return;
+    }
+    
+    printf("\n=== INTEREST PAYMENT ===\n");
+    printf("Interest rate: %.1f%%\n", INTEREST_RATE * 100);
+    printf("Interest earned: $%.2f\n", interest);
+    printf("New balance: $%.2f\n", user->balance);
+    
+    saveAccounts();
+}
+
+/**
+ * addInterestImpl() between its entry and return probes
+ */
+void addInterest(void) {
+    float before = accounts[currentUserIndex].balance;
+    PROBE2(interest__entry, currentUserIndex, CENTS(before));
+    addInterestImpl();
+    PROBE2(interest__return, currentUserIndex, CENTS(accounts[currentUserIndex].balance - before));
+}
+
+/**
+ * Page through the current user's transaction history, newest first
+ */
+void displayTransactionHistory(void) {
+    Event page[HISTORY_PAGE_SIZE];
+    long cursor = accounts[currentUserIndex].lastEventOffset;
+    
+    printf("\n=== TRANSACTION HISTORY ===\n");
+    
+    while (true) {
+        int count = readAccountHistory(&cursor, page, HISTORY_PAGE_SIZE);
+        
+        for (int i = 0; i < count; i++) {
+            time_t seconds = (time_t)(page[i].timestamp / 1000000LL);
+            char when[20];
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+            printf("%s  %-20s %12.2f  (cash %+.2f)\n", when, eventTypeName(page[i].type),
+                   page[i].amount, page[i].balanceDelta);
+        }
+        
+        if (count == 0 || cursor < 0) {
+            printf("--- End of history ---\n");
+            return;
+        }
+        
+        int more;
+        if (!getIntInput("Show older transactions? (1=Yes, 0=No): ", &more) || more != 1) {
+            return;
+        }
+    }
+}
+
+/**
+ * Display comprehensive account status
+ */
+void displayAccountStatus(void) {
+    Account *user = &accounts[currentUserIndex];
+    
+    // Value holdings per instrument kind
+    float totals[INSTRUMENT_KIND_COUNT];
+    valueHoldings(currentUserIndex, totals);
+    float totalAssets = totals[INSTRUMENT_ASSET];
+    float totalForex = totals[INSTRUMENT_CURRENCY];
+    
+    // Calculate net worth
+    float netWorth = user->balance + totalAssets + totalForex - user->loan;
+    
+    printf("\n╔════════════════════════════════════════╗\n");
+    printf("║        ACCOUNT STATUS REPORT           ║\n");
+    printf("╠════════════════════════════════════════╣\n");
+    printf("║ Account Holder: %-22s ║\n", user->name);
+    printf("╠════════════════════════════════════════╣\n");
+    printf("║ CASH                                   ║\n");
+    printf("║   Balance:           $%15.2f  ║\n", user->balance);
+    printf("║   Loan:             -$%15.2f  ║\n", user->loan);
+    printf("╠════════════════════════════════════════╣\n");
+    printf("║ ASSETS                                 ║\n");
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == INSTRUMENT_ASSET) {
+            char label[INSTRUMENT_CODE_LENGTH + 1];
+            snprintf(label, sizeof(label), "%.*s:", INSTRUMENT_CODE_LENGTH - 1, instruments[i].code);
+            printf("║   %-8s%8.4f units  $%11.2f  ║\n", label,
+                   holdings[i][currentUserIndex], holdings[i][currentUserIndex] * instrumentPrices[i]);
+        }
+    }
+    printf("║   Total Assets:         $%11.2f  ║\n", totalAssets);
+    printf("╠════════════════════════════════════════╣\n");
+    printf("║ FOREIGN EXCHANGE                       ║\n");
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == INSTRUMENT_CURRENCY) {
+            printf("║   %-3.3s: %10.2f units  $%11.2f  ║\n", instruments[i].code,
+                   holdings[i][currentUserIndex], holdings[i][currentUserIndex] * instrumentPrices[i]);
+        }
+    }
+    printf("║   Total Forex:          $%11.2f  ║\n", totalForex);
+    printf("╠════════════════════════════════════════╣\n");
+    printf("║ NET WORTH:              $%11.2f  ║\n", netWorth);
+    printf("╚════════════════════════════════════════╝\n");
+}
+
+/**
+ * Prompt for a currency slot from the wallet list
+ */
+bool getCurrencyInput(const char *prompt, int *slot) {
+    int choice;
+    if (!getIntInput(prompt, &choice) || choice < 1 || choice > currencyCount) {
+        return false;
+    }
+    *slot = choice - 1;
+    return true;
+}
+
+/**
+ * Manage foreign currency wallet
+ */
+static void manageForexWalletImpl(void) {
+    printf("\n=== FOREX WALLET ===\n");
+    for (int slot = 0; slot < currencyCount; slot++) {
+        float held = *walletBalance(currentUserIndex, slot);
+        printf("%d. %s: %.2f (≈ $%.2f)\n", slot + 1, currencyCode(slot), held,
+               held * currencyQuote(slot));
+    }
+    
+    printf("\n1. Convert Currency\n");
+    printf("2. Back\n");
+    
+    int choice;
+    if (!getIntInput("\nChoice: ", &choice)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    if (choice != 1) {
+        return;
+    }
+    
+    int from, to;
+    float amount;
+    
+    if (!getCurrencyInput("Convert from (wallet #): ", &from) ||
+        !getCurrencyInput("Convert to (wallet #): ", &to)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    printf("Rate: 1 %s = %.4f %s\n", currencyCode(from), exchangeRate(from, to), currencyCode(to));
+    if (!getFloatInput("Enter amount to convert: ", &amount)) {
+        displayError(ERROR_INVALID_INPUT);
+        return;
+    }
+    
+    float received;
+    ErrorCode result = convertCurrency(currentUserIndex, from, to, amount, &received);
+    if (result != SUCCESS) {
+        displayError(result);
+        return;
+    }
+    
+    printf("\n[SUCCESS] Converted %.2f %s to %.2f %s\n", amount, currencyCode(from),
+           received, currencyCode(to));
+    saveAccounts();
+}
+
+/**
+ * manageForexWalletImpl() between its entry and return probes
+ */
+void manageForexWallet(void) {
+    float before = accounts[currentUserIndex].balance;
+    PROBE2(forex__entry, currentUserIndex, CENTS(before));
+    manageForexWalletImpl();
+    PROBE2(forex__return, currentUserIndex, CENTS(accounts[currentUserIndex].balance - before));
+}
+
+// ==================== BATCH OPERATIONS ====================
+
+/**
+ * Find or insert the netting position for a currency pair
+ */
+static FxNetPosition *fxNetPosition(FxNetPosition *table, int *used, int mask, int low, int high) {
+    unsigned int slot = ((unsigned int)low * 2654435761u ^ (unsigned int)high) & (unsigned int)mask;
+    
+    while (table[slot].gross >= 0) {
+        if (table[slot].low == low && table[slot].high == high) {
+            return &table[slot];
+        }
+        slot = (slot + 1) & (unsigned int)mask;
+    }
+    
+    FxNetPosition *position = &table[slot];
+    position->low = low;
+    position->high = high;
+    position->lowToHigh = exchangeRate(low, high);
+    position->highToLow = exchangeRate(high, low);
+    position->gross = 0.0;
+    position->net = 0.0;
+    (*used)++;
+    return position;
+}
+
+/**
+ * Convert a batch of FX orders. Every order is priced from one rate
+ * snapshot per currency pair, posted to its account in a single pass, and
+ * the batch is persisted with one save. Netting is reporting only: each
+ * customer's conversion is committed in full, and the summary's net
+ * volume shows how much of the executed flow offsets within the batch.
+ */
+ErrorCode convertCurrencyBatch(const FxOrder *orders, int count, FxResult *results,
+                               FxBatchSummary *summary) {
+    TRACE_SCOPE("convertCurrencyBatch");
+    ALLOC_SCOPE(ALLOC_FOREX);
+    memset(summary, 0, sizeof(*summary));
+    if (count <= 0) {
+        return SUCCESS;
+    }
+    
+    int capacity = 1;
+    while (capacity < count * 2) {
+        capacity <<= 1;
+    }
+    
+    FxNetPosition *table = malloc(sizeof(FxNetPosition) * capacity);
+    FxNetPosition **orderPosition = malloc(sizeof(FxNetPosition *) * count);
+    if (table == NULL || orderPosition == NULL) {
+        free(table);
+        free(orderPosition);
+        return ERROR_INVALID_INPUT;
+    }
+    for (int i = 0; i < capacity; i++) {
+        table[i].gross = -1.0; // Marks an empty slot
+    }
+    
+    // Pass 1: validate and net each order into its pair position
+    for (int i = 0; i < count; i++) {
+        const FxOrder *order = &orders[i];
+        orderPosition[i] = NULL;
+        results[i].received = 0.0f;
+        
+        if (order->accountIndex < 0 || order->accountIndex >= accountCount ||
+            order->from < 0 || order->from >= currencyCount ||
+            order->to < 0 || order->to >= currencyCount ||
+            order->from == order->to || order->amount <= 0) {
+            results[i].status = ERROR_INVALID_INPUT;
+            continue;
+        }
+        if (blockedPairs[order->from][order->to]) {
+            results[i].status = ERROR_RATE_BLOCKED;
+            continue;
+        }
+        
+        int low = order->from < order->to ? order->from : order->to;
+        int high = order->from < order->to ? order->to : order->from;
+        FxNetPosition *position = fxNetPosition(table, &summary->pairs, capacity - 1, low, high);
+        
+        double lowUnits = (order->from == low) ? order->amount : order->amount * position->highToLow;
+        position->gross += lowUnits;
+        position->net += (order->from == low) ? lowUnits : -lowUnits;
+        
+        orderPosition[i] = position;
+        results[i].status = SUCCESS;
+    }
+    
+    // Pass 2: post every order at its pair's snapshot rate
+    for (int i = 0; i < count; i++) {
+        FxNetPosition *position = orderPosition[i];
+        if (position == NULL) {
+            summary->rejected++;
+            continue;
+        }
+        
+        const FxOrder *order = &orders[i];
+        float *source = walletBalance(order->accountIndex, order->from);
+        float rate = (order->from == position->low) ? position->lowToHigh : position->highToLow;
+        
+        if (order->amount > *source) {
+            results[i].status = ERROR_INSUFFICIENT_FUNDS;
+        } else {
+            Event event = makeEvent(EVENT_CURRENCY_CONVERSION, order->accountIndex);
+            event.amount = order->amount;
+            addWalletLeg(&event, order->from, -order->amount);
+            addWalletLeg(&event, order->to, order->amount * rate);
+            results[i].status = commitEvent(&event);
+        }
+        if (results[i].status != SUCCESS) {
+            // Back the order out of the pair's net so the report covers executed orders only
+            double lowUnits = (order->from == position->low) ? order->amount : order->amount * rate;
+            position->gross -= lowUnits;
+            position->net -= (order->from == position->low) ? lowUnits : -lowUnits;
+            summary->rejected++;
+            continue;
+        }
+        results[i].received = order->amount * rate;
+        summary->executed++;
+    }
+    
+    // The net of each pair is the flow left after offsetting orders; nothing is booked for it
+    for (int i = 0; i < capacity; i++) {
+        if (table[i].gross >= 0) {
+            double usdPerLow = currencyQuote(table[i].low);
+            summary->grossUsd += table[i].gross * usdPerLow;
+            summary->netUsd += fabs(table[i].net) * usdPerLow;
+        }
+    }
+    
+    free(table);
+    free(orderPosition);
+    
+    return summary->executed > 0 ? saveAccounts() : SUCCESS;
+}
+
+/**
+ * Run an FX batch file ("NAME FROM TO AMOUNT" per line)
+ */
+ErrorCode runFxBatchFile(const char *path) {
+    ALLOC_SCOPE(ALLOC_FOREX);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return ERROR_FILE_IO;
+    }
+    
+    int capacity = 1024;
+    int count = 0;
+    FxOrder *orders = malloc(sizeof(FxOrder) * capacity);
+    char name[MAX_NAME_LENGTH];
+    char fromCode[INSTRUMENT_CODE_LENGTH], toCode[INSTRUMENT_CODE_LENGTH];
+    float amount;
+    
+    while (orders != NULL && fscanf(file, "%49s %7s %7s %f", name, fromCode, toCode, &amount) == 4) {
+        if (count == capacity) {
+            capacity *= 2;
+            FxOrder *grown = realloc(orders, sizeof(FxOrder) * capacity);
+            if (grown == NULL) {
+                break;
+            }
+            orders = grown;
+        }
+        orders[count++] = (FxOrder){findAccount(name), findCurrency(fromCode), findCurrency(toCode), amount};
+    }
+    fclose(file);
+    
+    FxResult *results = malloc(sizeof(FxResult) * (count > 0 ? count : 1));
+    if (orders == NULL || results == NULL) {
+        free(orders);
+        free(results);
+        return ERROR_INVALID_INPUT;
+    }
+    
+    FxBatchSummary summary;
+    ErrorCode result = convertCurrencyBatch(orders, count, results, &summary);
+    
+    for (int i = 0; i < count; i++) {
+        if (results[i].status != SUCCESS) {
+            printf("Order %d rejected:", i + 1);
+            displayError(results[i].status);
+        }
+    }
+    printf("\n[INFO] FX batch: %d executed, %d rejected across %d pair(s).\n",
+           summary.executed, summary.rejected, summary.pairs);
+    printf("[INFO] Gross volume $%.2f nets to $%.2f across pairs (report only; every order was booked in full).\n",
+           summary.grossUsd, summary.netUsd);
+    
+    free(orders);
+    free(results);
+    return result;
+}
+
+/**
+ * Read the account count and stored state root from a data file's header.
+ * Returns the count (-1 if unreadable); the root's tree shape is 0 when
+ * the file does not record one.
+ */
+static int snapshotAccountCount(const char *path, int *merkleLeaves, unsigned long long *stateRoot) {
+    int count = -1;
+    *merkleLeaves = 0;
+    *stateRoot = 0;
+    FILE *file = fopen(path, "rb");
+    if (file != NULL) {
+        SnapshotHeader header;
+        if (readSnapshotHeader(file, &header)) {
+            count = header.accountCount;
+            *merkleLeaves = header.merkleLeaves;
+            *stateRoot = header.stateRoot;
+        } else if (fseek(file, 0, SEEK_SET) != 0 || fread(&count, sizeof(int), 1, file) != 1) {
+            count = -1; // Older files start with the bare count
+        }
+        fclose(file);
+    }
+    return count;
+}
+
+/**
+ * Compare two account data files through their hash trees and list the
+ * accounts that differ. Files whose headers record equal roots over the
+ * same tree shape are identical without reading further; otherwise both
+ * trees are rebuilt. Returns the number of differences (-1 on error).
+ */
+int diffStateFiles(const char *pathA, const char *pathB) {
+    TRACE_SCOPE("diffStateFiles");
+    MerkleTree treeA = {0, NULL}, treeB = {0, NULL};
+    int leavesA, leavesB;
+    unsigned long long rootA, rootB;
+    int countA = snapshotAccountCount(pathA, &leavesA, &rootA);
+    int countB = snapshotAccountCount(pathB, &leavesB, &rootB);
+    int found = -1;
+    
+    if (countA >= 0 && countA == countB && leavesA > 0 && leavesA == leavesB && rootA == rootB) {
+        printf("\n%s root: %016llx\n", pathA, rootA);
+        printf("%s root: %016llx\n", pathB, rootB);
+        return 0;
+    }
+    
+    // Both trees need the same shape, so size the table for the larger file
+    if (countA < 0 || countB < 0 || !ensureAccountCapacity(countA > countB ? countA : countB)) {
+        return -1;
+    }
+    Account *copyA = malloc(sizeof(Account) * (size_t)(countA > 0 ? countA : 1));
+    int *differences = malloc(sizeof(int) * (size_t)accountCapacity);
+    if (copyA == NULL || differences == NULL ||
+        !merkleInit(&treeA, accountCapacity) || !merkleInit(&treeB, accountCapacity)) {
+        goto cleanup;
+    }
+    
+    FILE *file = fopen(pathA, "rb");
+    if (file == NULL || !readSnapshot(file)) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        goto cleanup;
+    }
+    fclose(file);
+    merkleRebuild(&treeA);
+    memcpy(copyA, accounts, sizeof(Account) * accountCount);
+    countA = accountCount;
+    
+    file = fopen(pathB, "rb");
+    if (file == NULL || !readSnapshot(file)) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        goto cleanup;
+    }
+    fclose(file);
+    merkleRebuild(&treeB);
+    
+    printf("\n%s root: %016llx\n", pathA, treeA.nodes[1]);
+    printf("%s root: %016llx\n", pathB, treeB.nodes[1]);
+    
+    found = merkleDiff(&treeA, &treeB, 1, differences, accountCapacity);
+    for (int i = 0; i < found; i++) {
+        int index = differences[i];
+        printf("Slot %d differs: %s / %s\n", index,
+               index < countA ? copyA[index].name : "(none)",
+               index < accountCount ? accounts[index].name : "(none)");
+    }
+    
+cleanup:
+    free(copyA);
+    free(differences);
+    free(treeA.nodes);
+    free(treeB.nodes);
+    return found;
+}
+
+// ==================== REPLICATION ====================
+
+/**
+ * Hot-standby state: a tail thread applies the primary's journal while the
+ * query loop serves read-only requests under the same lock
+ */
+static pthread_mutex_t followerLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool followerRunning;
+static unsigned long long followerApplied;       // Events applied so far
+static long long followerApplyDelayMicros;        // Write-to-apply delay of the last event
+
+/**
+ * Tail the journal with positioned reads, applying complete records in
+ * sequence. The primary flushes an event only once it has committed
+ * (commitEventImpl), so whole records in the file are the commit point.
+ * Torn trailing records are simply re-read on the next poll; a record
+ * whose sequence is not the next one is never applied, and if it stays
+ * wrong the follower resyncs from the primary's newest checkpoint.
+ */
+static void *followerTail(void *arg) {
+    int fd = *(int *)arg;
+    static Event batch[FOLLOWER_READ_BATCH];
+    struct timespec pause = {0, FOLLOWER_POLL_MICROS * 1000L};
+    int mismatchedPolls = 0;
+    unsigned long long resyncedAt = ULLONG_MAX; // Mismatch position of the last resync
+    
+    while (atomic_load(&followerRunning)) {
+        off_t offset = (off_t)(followerApplied * sizeof(Event));
+        ssize_t bytes = pread(fd, batch, sizeof(batch), offset);
+        int records = bytes > 0 ? (int)(bytes / (ssize_t)sizeof(Event)) : 0;
+        
+        // Stop at the first record out of sequence
+        int valid = 0;
+        while (valid < records && batch[valid].sequence == followerApplied + (unsigned long long)valid) {
+            valid++;
+        }
+        mismatchedPolls = valid == 0 && records > 0 ? mismatchedPolls + 1 : 0;
+        
+        // Resync once per position; a record still wrong after that is waited on
+        if (mismatchedPolls >= FOLLOWER_RESYNC_POLLS && followerApplied != resyncedAt) {
+            resyncedAt = followerApplied;
+            JournalIndexEntry latest;
+            pthread_mutex_lock(&followerLock);
+            ErrorCode result = findCheckpoint(LLONG_MAX, &latest);
+            if (result == SUCCESS) {
+                result = restoreCheckpoint(&latest);
+            }
+            if (result == SUCCESS) {
+                followerApplied = latest.sequence;
+            }
+            pthread_mutex_unlock(&followerLock);
+            printf("\n[WARNING] Journal out of sequence at event %llu; %s.\n", resyncedAt,
+                   result == SUCCESS ? "resynced from the newest checkpoint" : "could not resync, still waiting");
+            mismatchedPolls = 0;
+            continue;
+        }
+        if (valid == 0) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        
+        pthread_mutex_lock(&followerLock);
+        for (int i = 0; i < valid; i++) {
+            applyEvent(&batch[i]);
+        }
+        followerApplied += valid;
+        followerApplyDelayMicros = currentTimeMicros() - batch[valid - 1].timestamp;
+        pthread_mutex_unlock(&followerLock);
+    }
+    
+    return NULL;
+}
+
+/**
+ * Print how far the follower trails the primary's journal
+ */
+static void printReplicationLag(int fd) {
+    struct stat info;
+    unsigned long long written = fstat(fd, &info) == 0 ? (unsigned long long)info.st_size / sizeof(Event) : 0;
+    
+    pthread_mutex_lock(&followerLock);
+    unsigned long long applied = followerApplied;
+    long long delay = followerApplyDelayMicros;
+    pthread_mutex_unlock(&followerLock);
+    
+    printf("Applied %llu of %llu event(s), %llu behind; last event applied %.3f ms after it was written.\n",
+           applied, written, written > applied ? written - applied : 0, delay / 1000.0);
+}
+
+/**
+ * Run as a hot standby of the primary whose files are in 'directory':
+ * restore its latest checkpoint, tail its journal, and answer read-only
+ * queries. Returns true if the follower was promoted to primary, in which
+ * case in-memory state is current and the caller takes over the journal.
+ */
+bool runFollower(const char *directory) {
+    if (chdir(directory) != 0) {
+        displayError(ERROR_FILE_IO);
+        return false;
+    }
+    
+    JournalIndexEntry latest;
+    ErrorCode result = findCheckpoint(LLONG_MAX, &latest);
+    if (result == SUCCESS) {
+        result = restoreCheckpoint(&latest);
+    }
+    if (result != SUCCESS) {
+        displayError(result);
+        return false;
+    }
+    
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) {
+        displayError(ERROR_FILE_IO);
+        return false;
+    }
+    
+    followerApplied = latest.sequence;
+    atomic_store(&followerRunning, true);
+    pthread_t tail;
+    if (pthread_create(&tail, NULL, followerTail, &fd) != 0) {
+        close(fd);
+        displayError(ERROR_FILE_IO);
+        return false;
+    }
+    
+    printf("\n[INFO] Following journal in %s from event %llu.\n", directory, latest.sequence);
+    printf("Commands: status NAME | lag | root | promote | quit\n");
+    
+    bool promote = false;
+    char line[128];
+    char name[MAX_NAME_LENGTH];
+    
+    while (printf("follower> "), fflush(stdout), fgets(line, sizeof(line), stdin) != NULL) {
+        if (sscanf(line, "status %49s", name) == 1) {
+            pthread_mutex_lock(&followerLock);
+            int index = findAccount(name);
+            if (index >= 0) {
+                printAccountSummary(index);
+            } else {
+                printf("No such account.\n");
+            }
+            pthread_mutex_unlock(&followerLock);
+        } else if (strncmp(line, "lag", 3) == 0) {
+            printReplicationLag(fd);
+        } else if (strncmp(line, "root", 4) == 0) {
+            pthread_mutex_lock(&followerLock);
+            printf("%d account(s), state root %016llx\n", accountCount, stateTree.nodes[1]);
+            pthread_mutex_unlock(&followerLock);
+        } else if (strncmp(line, "promote", 7) == 0) {
+            promote = true;
+            break;
+        } else if (strncmp(line, "quit", 4) == 0) {
+            break;
+        } else {
+            printf("Unknown command.\n");
+        }
+    }
+    
+    atomic_store(&followerRunning, false);
+    pthread_join(tail, NULL);
+    
+    // Drain whatever the primary committed before it went away
+    if (promote) {
+        Event event;
+        while (pread(fd, &event, sizeof(event), (off_t)(followerApplied * sizeof(Event))) ==
+               (ssize_t)sizeof(event) && event.sequence == followerApplied) {
+            applyEvent(&event);
+            followerApplied++;
+        }
+        printReplicationLag(fd);
+    }
+    
+    close(fd);
+    return promote;
+}
+
+// ==================== REQUEST ENGINE ====================
+
+static DedupeWindow *dedupe = NULL;
+
+static unsigned int dedupeSlot(unsigned long long transactionId, int accountIndex) {
+    unsigned long long hash = (transactionId ^ ((unsigned long long)accountIndex << 48)) * 0x9e3779b97f4a7c15ULL;
+    return (unsigned int)(hash >> 40) & (DEDUPE_CAPACITY * 2 - 1);
+}
+
+/**
+ * Find a remembered transaction for an account (NULL if unseen or older
+ * than the window)
+ */
+static DedupeEntry *dedupeFind(unsigned long long transactionId, int accountIndex, long long now) {
+    for (unsigned int slot = dedupeSlot(transactionId, accountIndex); dedupe->index[slot] >= 0;
+         slot = (slot + 1) & (DEDUPE_CAPACITY * 2 - 1)) {
+        DedupeEntry *entry = &dedupe->entries[dedupe->index[slot]];
+        if (entry->transactionId == transactionId && entry->accountIndex == accountIndex) {
+            // Entries past the window are only waiting for eviction
+            return now - entry->timestamp > DEDUPE_WINDOW_MICROS ? NULL : entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Whether an outcome is final, so a retry should see it again. Transient
+ * failures are left out so the client's retry is actually executed.
+ */
+static bool dedupeDefinitive(ErrorCode result) {
+    return result != ERROR_FILE_IO && result != ERROR_BUSY && result != ERROR_RATE_BLOCKED;
+}
+
+/**
+ * Drop the oldest entry, shifting later probes back so lookups never
+ * stop early at the hole it leaves
+ */
+static void dedupeEvictOldest(void) {
+    const unsigned int mask = DEDUPE_CAPACITY * 2 - 1;
+    DedupeEntry *entry = &dedupe->entries[dedupe->oldest];
+    unsigned int hole = dedupeSlot(entry->transactionId, entry->accountIndex);
+    
+    while (dedupe->index[hole] != (int)dedupe->oldest) {
+        hole = (hole + 1) & mask;
+    }
+    for (unsigned int next = (hole + 1) & mask; dedupe->index[next] >= 0; next = (next + 1) & mask) {
+        DedupeEntry *moved = &dedupe->entries[dedupe->index[next]];
+        unsigned int home = dedupeSlot(moved->transactionId, moved->accountIndex);
+        // Move back only if the hole lies on the cyclic probe path home..next
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            dedupe->index[hole] = dedupe->index[next];
+            hole = next;
+        }
+    }
+    dedupe->index[hole] = -1;
+    
+    dedupe->oldest = (dedupe->oldest + 1) & (DEDUPE_CAPACITY - 1);
+    dedupe->count--;
+}
+
+/**
+ * Remember a transaction's outcome, evicting entries past the window
+ */
+static void dedupeRecord(const Request *request, const Response *response, long long now) {
+    while (dedupe->count > 0 && (dedupe->count == DEDUPE_CAPACITY ||
+                                 now - dedupe->entries[dedupe->oldest].timestamp > DEDUPE_WINDOW_MICROS)) {
+        dedupeEvictOldest();
+    }
+    
+    unsigned int position = (dedupe->oldest + dedupe->count) & (DEDUPE_CAPACITY - 1);
+    dedupe->entries[position] = (DedupeEntry){request->transactionId, response->accountIndex, now, *response};
+    dedupe->count++;
+    
+    unsigned int slot = dedupeSlot(request->transactionId, response->accountIndex);
+    while (dedupe->index[slot] >= 0) {
+        slot = (slot + 1) & (DEDUPE_CAPACITY * 2 - 1);
+    }
+    dedupe->index[slot] = (int)position;
+}
+
+/**
+ * Allocate the dedupe window on first use
+ */
+static bool dedupeInit(void) {
+    if (dedupe == NULL) {
+        ALLOC_SCOPE(ALLOC_REQUEST_ENGINE);
+        dedupe = calloc(1, sizeof(DedupeWindow));
+        if (dedupe == NULL) {
+            return false;
+        }
+        memset(dedupe->index, 0xff, sizeof(dedupe->index));
+    }
+    return true;
+}
+
+/**
+ * Execute one request against in-memory state without any terminal I/O.
+ * Requests without an account index are resolved by name. State changes
+ * go through commitEvent(); persisting the account file is left to the
+ * caller so transports can group it. A mutating request that repeats a
+ * recent transaction id returns the first outcome instead of re-applying.
+ */
+static ErrorCode executeRequestImpl(const Request *request, Response *response) {
+    memset(response, 0, sizeof(*response));
+    response->requestId = request->requestId;
+    response->accountIndex = request->accountIndex;
+    
+    int index = request->accountIndex;
+    ErrorCode result = SUCCESS;
+    bool authenticated = false;
+    DedupeEntry *remembered;
+    
+    if (request->op == OP_LOGIN) {
+        char name[MAX_NAME_LENGTH];
+        snprintf(name, sizeof(name), "%s", request->name);
+        index = findAccount(name);
+        if (index < 0 || accounts[index].pin != request->pin) {
+            result = ERROR_INVALID_PIN;
+        }
+    } else if ((index < 0 && request->name[0] != '\0' && (index = findAccount(request->name)) < 0) ||
+               index < 0 || index >= accountCount || accounts[index].pin != request->pin) {
+        result = ERROR_INVALID_PIN;
+    } else if (request->transactionId != 0 && request->op != OP_STATUS && dedupeInit() &&
+               (remembered = dedupeFind(request->transactionId, index, currentTimeMicros())) != NULL) {
+        *response = remembered->response;
+        response->requestId = request->requestId;
+        dedupe->replays++;
+        return (ErrorCode)response->status;
+    } else {
+        authenticated = true;
+        Account *account = &accounts[index];
+        Event event;
+        
+        switch (request->op) {
+            case OP_DEPOSIT:
+            case OP_WITHDRAW:
+                if (request->amount <= 0) {
+                    result = ERROR_INVALID_INPUT;
+                    break;
+                }
+                event = makeEvent(request->op == OP_DEPOSIT ? EVENT_DEPOSIT : EVENT_WITHDRAWAL, index);
+                event.amount = request->amount;
+                event.balanceDelta = request->op == OP_DEPOSIT ? request->amount : -request->amount;
+                result = commitEvent(&event);
+                break;
+            case OP_PURCHASE:
+                if (request->instrument < 0 || request->instrument >= instrumentCount ||
+                    instruments[request->instrument].kind != INSTRUMENT_ASSET) {
+                    result = ERROR_INVALID_INPUT;
+                    break;
+                }
+                event = makeEvent(EVENT_ASSET_PURCHASE, index);
+                event.amount = ASSET_PURCHASE_AMOUNT;
+                event.balanceDelta = -ASSET_PURCHASE_AMOUNT;
+                event.instrument = request->instrument;
+                event.instrumentDelta = ASSET_PURCHASE_AMOUNT / instrumentPrices[request->instrument];
+                result = commitEvent(&event);
+                response->value = event.instrumentDelta;
+                break;
+            case OP_LOAN:
+                // Take the standard loan, or repay an outstanding one in full
+                event = makeEvent(account->loan == 0 ? EVENT_LOAN_TAKEN : EVENT_LOAN_REPAID, index);
+                event.amount = account->loan == 0 ? LOAN_AMOUNT : account->loan;
+                event.balanceDelta = account->loan == 0 ? LOAN_AMOUNT : -account->loan;
+                event.loanDelta = account->loan == 0 ? LOAN_AMOUNT : -account->loan;
+                result = commitEvent(&event);
+                break;
+            case OP_INTEREST:
+                event = makeEvent(EVENT_INTEREST, index);
+                event.amount = account->balance * INTEREST_RATE;
+                event.balanceDelta = event.amount;
+                result = commitEvent(&event);
+                break;
+            case OP_CONVERT:
+                result = convertCurrency(index, request->instrument, request->counterInstrument,
+                                         request->amount, &response->value);
+                break;
+            case OP_STATUS: {
+                float totals[INSTRUMENT_KIND_COUNT];
+                valueHoldings(index, totals);
+                response->value = totals[INSTRUMENT_ASSET] + totals[INSTRUMENT_CURRENCY];
+                break;
+            }
+            default:
+                result = ERROR_INVALID_INPUT;
+        }
+    }
+    
+    if (result == SUCCESS && index >= 0) {
+        response->balance = accounts[index].balance;
+        response->loan = accounts[index].loan;
+    }
+    response->accountIndex = index;
+    response->status = result;
+    // Only outcomes of requests that passed the PIN check are remembered,
+    // so a wrong PIN cannot reserve another account's transaction id
+    if (authenticated && request->transactionId != 0 && request->op != OP_STATUS &&
+        dedupe != NULL && dedupeDefinitive(result)) {
+        dedupeRecord(request, response, currentTimeMicros());
+    }
+    return result;
+}
+
+/**
+ * executeRequestImpl() between its entry and return probes
+ */
+ErrorCode executeRequest(const Request *request, Response *response) {
+    ALLOC_OPERATION(request->op);
+    PROBE3(request__entry, request->op, request->accountIndex, CENTS(request->amount));
+    ErrorCode result = executeRequestImpl(request, response);
+    metricRequest(request->op, result);
+    PROBE3(request__return, request->op, response->accountIndex, result);
+    return result;
+}
+
+// ==================== DAEMON TRANSPORT ====================
+
+static void futexWait(atomic_uint *word, unsigned int expected, long timeoutMicros) {
+    struct timespec timeout = {timeoutMicros / 1000000L, (timeoutMicros % 1000000L) * 1000L};
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+static void futexWake(atomic_uint *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static bool ringEmpty(RingControl *ring) {
+    return atomic_load(&ring->tail) == atomic_load(&ring->head);
+}
+
+/**
+ * Publish a run of filled slots and wake the consumer only if it parked
+ */
+static void ringPublish(RingControl *ring, unsigned int count, atomic_uint *consumerSleeping) {
+    atomic_fetch_add(&ring->head, count);
+    if (atomic_load(consumerSleeping)) {
+        atomic_store(consumerSleeping, 0);
+        futexWake(consumerSleeping);
+    }
+}
+
+/**
+ * Park a consumer on a futex word unless data arrives while it announces
+ * that it is going to sleep
+ */
+static void ringPark(atomic_uint *sleeping, bool (*hasWork)(void *), void *context) {
+    atomic_store(sleeping, 1);
+    if (!hasWork(context)) {
+        futexWait(sleeping, 1, RING_SLEEP_MICROS);
+    }
+    atomic_store(sleeping, 0);
+}
+
+static RingRegion *ringRegion = NULL;
+static volatile sig_atomic_t daemonStopping = 0;
+static volatile sig_atomic_t interestRequested = 0;
+static int interestCursor = -1;         // Next account of the bank-wide interest run (-1 = idle)
+
+static void stopDaemon(int signal) {
+    (void)signal;
+    daemonStopping = 1;
+}
+
+static void requestInterestRun(int signal) {
+    (void)signal;
+    interestRequested = 1;
+}
+
+static bool interactivePending(RingRegion *region) {
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        ClientChannel *channel = &region->channels[c];
+        if (atomic_load(&channel->state) == CHANNEL_CLAIMED && channel->priority == PRIORITY_INTERACTIVE &&
+            !ringEmpty(&channel->requests)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * True when a batch loop should yield: its slice is spent or an
+ * interactive request is waiting. Only checked every few items.
+ */
+static bool batchShouldYield(int done, long long deadline) {
+    return done % PREEMPT_CHECK_INTERVAL == 0 && done > 0 &&
+           (interactivePending(ringRegion) || currentTimeMicros() >= deadline);
+}
+
+static bool anyRequestPending(void *context) {
+    RingRegion *region = context;
+    if (interestRequested || interestCursor >= 0) {
+        return true;
+    }
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        if (atomic_load(&region->channels[c].state) == CHANNEL_CLAIMED &&
+            !ringEmpty(&region->channels[c].requests)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool responsePending(void *context) {
+    return !ringEmpty(&((ClientChannel *)context)->responses);
+}
+
+/**
+ * Whether a daemon is serving the region: it stamped the magic and its
+ * process still exists (a killed daemon never clears the magic)
+ */
+static bool daemonAlive(RingRegion *region) {
+    return atomic_load(&region->magic) == RING_REGION_MAGIC &&
+           (kill(region->daemonPid, 0) == 0 || errno != ESRCH);
+}
+
+static int ringRegionFd = -1;           // Daemon's handle; its lock claims the region
+
+/**
+ * Map the ring region; the daemon creates it, clients open the existing one.
+ * The daemon holds an exclusive lock on the region for as long as it runs,
+ * so a second daemon fails with EWOULDBLOCK instead of resetting the rings
+ * under the first. The kernel drops the lock if the holder dies.
+ */
+static RingRegion *mapRingRegion(bool create) {
+    int fd = create ? shm_open(RING_REGION_NAME, O_RDWR | O_CREAT, 0600)
+                    : shm_open(RING_REGION_NAME, O_RDWR, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (create) {
+        struct stat info;
+        bool claimed = flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &info) == 0;
+        if (claimed && info.st_nlink == 0) {
+            // A daemon unlinked it while shutting down; claim a fresh region instead
+            close(fd);
+            return mapRingRegion(true);
+        }
+        if (!claimed || ftruncate(fd, sizeof(RingRegion)) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return NULL;
+        }
+    }
+    
+    RingRegion *region = mmap(NULL, sizeof(RingRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (create && region != MAP_FAILED) {
+        ringRegionFd = fd;
+    } else {
+        close(fd);
+    }
+    return region == MAP_FAILED ? NULL : region;
+}
+
+/**
+ * Release channels whose client process has exited, emptying their rings
+ * so requests the client left behind are never served to the next owner
+ */
+static void reapDeadClients(RingRegion *region) {
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        ClientChannel *channel = &region->channels[c];
+        if (atomic_load(&channel->state) == CHANNEL_CLAIMED && kill(channel->pid, 0) != 0 && errno == ESRCH) {
+            LOG_EVENT(LOG_CLIENT_REAPED, c, channel->pid, 0, 0);
+            atomic_store(&channel->requests.head, 0);
+            atomic_store(&channel->requests.tail, 0);
+            atomic_store(&channel->responses.head, 0);
+            atomic_store(&channel->responses.tail, 0);
+            atomic_store(&channel->state, CHANNEL_FREE);
+        }
+    }
+}
+
+/**
+ * Decide whether a client may run its next request: it needs a token
+ * from its bucket and, while the global queue is over its limit, must be
+ * within its fair share of that limit
+ */
+static bool admitRequest(ClientChannel *channel, unsigned int position, unsigned int fairShare) {
+    if (channel->tokens < 1.0 || position >= fairShare) {
+        atomic_fetch_add(&channel->rejected, 1);
+        return false;
+    }
+    channel->tokens -= 1.0;
+    atomic_fetch_add(&channel->admitted, 1);
+    return true;
+}
+
+static void refillTokens(ClientChannel *channel, long long now) {
+    if (channel->lastRefill != 0) {
+        channel->tokens += (now - channel->lastRefill) * (CLIENT_RATE_PER_SECOND / 1e6);
+        if (channel->tokens > CLIENT_BURST) {
+            channel->tokens = CLIENT_BURST;
+        }
+    }
+    channel->lastRefill = now;
+}
+
+/**
+ * Execute the queued requests of one channel into its response ring
+ * without publishing them. Batch channels stop at a preemption point.
+ * Returns the number of responses written.
+ */
+static int serveChannel(ClientChannel *channel, unsigned int fairShare, long long deadline) {
+    int written = 0;
+    
+    // Only take requests whose responses are guaranteed a slot
+    unsigned int tail = atomic_load(&channel->requests.tail);
+    unsigned int head = atomic_load(&channel->requests.head);
+    unsigned int responseHead = atomic_load(&channel->responses.head);
+    unsigned int space = RING_CAPACITY - (responseHead - atomic_load(&channel->responses.tail));
+    
+    for (; tail != head && (unsigned int)written < space; tail++) {
+        if (channel->priority == PRIORITY_BATCH && batchShouldYield(written, deadline)) {
+            break;
+        }
+        Request *request = &channel->requestSlots[tail % RING_CAPACITY];
+        Response *response = &channel->responseSlots[(responseHead + written) % RING_CAPACITY];
+        
+        if (request->op == OP_LOGIN || admitRequest(channel, (unsigned int)written, fairShare)) {
+            executeRequest(request, response);
+        } else {
+            memset(response, 0, sizeof(*response));
+            response->requestId = request->requestId;
+            response->accountIndex = request->accountIndex;
+            response->status = ERROR_BUSY;
+            metricRequest(request->op, ERROR_BUSY);
+            LOG_EVENT(LOG_REQUEST_REFUSED, request->op, request->accountIndex, channel->pid, 0);
+        }
+        written++;
+    }
+    atomic_store(&channel->requests.tail, tail);
+    return written;
+}
+
+/**
+ * Credit interest to every account as a background batch job, resuming
+ * from where the previous slice yielded. Returns the accounts credited.
+ */
+static int runInterestSlice(long long deadline) {
+    TRACE_SCOPE("interestSlice");
+    int credited = 0;
+    
+    // Preemption counts every account visited, so a run of rejected credits still yields
+    for (int visited = 0; interestCursor < accountCount; interestCursor++, visited++) {
+        if (batchShouldYield(visited, deadline)) {
+            return credited;
+        }
+        Event event = makeEvent(EVENT_INTEREST, interestCursor);
+        event.amount = accounts[interestCursor].balance * INTEREST_RATE;
+        event.balanceDelta = event.amount;
+        if (commitEvent(&event) == SUCCESS) {
+            credited++;
+        }
+    }
+    
+    printf("[INFO] Bank-wide interest run complete.\n");
+    fflush(stdout);
+    interestCursor = -1;
+    return credited;
+}
+
+/**
+ * Serve clients over shared-memory rings until SIGINT/SIGTERM. Each pass
+ * drains the interactive rings in full, then gives batch clients and the
+ * bank-wide interest job (started by SIGUSR1) one time slice that yields
+ * as soon as interactive work arrives. The journal is flushed once for
+ * the whole pass before responses are published; the account file is
+ * written when the daemon goes idle. Requests over a client's rate or the
+ * global queue limit are answered ERROR_BUSY without being applied.
+ */
+ErrorCode runDaemon(void) {
+    RingRegion *region = mapRingRegion(true);
+    if (region == NULL) {
+        if (errno == EWOULDBLOCK) {
+            printf("\n[ERROR] Another daemon is already serving %s.\n", RING_REGION_NAME);
+        }
+        return ERROR_FILE_IO;
+    }
+    memset(region, 0, sizeof(RingRegion));
+    region->daemonPid = getpid();
+    atomic_store(&region->magic, RING_REGION_MAGIC);
+    pthread_mutex_lock(&ringRegionLock);
+    ringRegion = region;
+    metricQueueDepth = &region->queueDepth;
+    pthread_mutex_unlock(&ringRegionLock);
+    
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+    signal(SIGUSR1, requestInterestRun);
+    printf("\n[INFO] Daemon serving %d account(s) on %s.\n", accountCount, RING_REGION_NAME);
+    fflush(stdout);
+    
+    static int pendingCount[MAX_RING_CLIENTS];
+    bool dirty = false;
+    int idlePasses = 0;
+    
+    while (!daemonStopping) {
+        int served = 0;
+        
+        // Measure the global queue; when over its limit each client keeps a fair share
+        unsigned int depth = 0;
+        unsigned int clients = 0;
+        for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+            ClientChannel *channel = &ringRegion->channels[c];
+            if (atomic_load(&channel->state) == CHANNEL_CLAIMED) {
+                unsigned int queued = atomic_load(&channel->requests.head) - atomic_load(&channel->requests.tail);
+                if (queued > atomic_load(&channel->maxDepth)) {
+                    atomic_store(&channel->maxDepth, queued);
+                }
+                depth += queued;
+                clients++;
+            }
+        }
+        atomic_store(&ringRegion->queueDepth, depth);
+        unsigned int fairShare = UINT_MAX;
+        if (depth > GLOBAL_QUEUE_LIMIT) {
+            fairShare = GLOBAL_QUEUE_LIMIT / clients;
+            atomic_fetch_add(&ringRegion->shedPasses, 1);
+            LOG_EVENT(LOG_QUEUE_SHEDDING, (int)depth, (int)clients, (int)fairShare, 0);
+        }
+        bool batchWork = interestRequested || interestCursor >= 0;
+        long long now = depth > 0 || batchWork ? currentTimeMicros() : 0;
+        
+        // Interactive clients first, then batch clients and the interest job within one slice
+        long long deadline = 0;
+        for (int priority = PRIORITY_INTERACTIVE; priority <= PRIORITY_BATCH; priority++) {
+            if (priority == PRIORITY_BATCH && now != 0) {
+                // The slice starts after the interactive pass so that pass cannot use it up
+                deadline = currentTimeMicros() + BATCH_SLICE_MICROS;
+            }
+            for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+                ClientChannel *channel = &ringRegion->channels[c];
+                if (priority == PRIORITY_INTERACTIVE) {
+                    pendingCount[c] = 0;
+                }
+                if (atomic_load(&channel->state) != CHANNEL_CLAIMED || channel->priority != priority) {
+                    continue;
+                }
+                if (now != 0) {
+                    refillTokens(channel, now);
+                }
+                pendingCount[c] = serveChannel(channel, fairShare, deadline);
+                served += pendingCount[c];
+            }
+        }
+        
+        if (interestRequested && interestCursor < 0) {
+            interestRequested = 0;
+            interestCursor = 0;
+        }
+        if (interestCursor >= 0) {
+            served += runInterestSlice(deadline);
+        }
+        
+        if (served > 0) {
+            // Group commit: one journal flush covers every response below
+            if (journalFile != NULL) {
+                fflush(journalFile);
+            }
+            if (postingsFile != NULL) {
+                fflush(postingsFile);
+            }
+            for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+                if (pendingCount[c] > 0) {
+                    ringPublish(&ringRegion->channels[c].responses, pendingCount[c],
+                                &ringRegion->channels[c].responses.sleeping);
+                }
+            }
+            dirty = true;
+            idlePasses = 0;
+            continue;
+        }
+        
+        if (++idlePasses < RING_SPIN_ITERATIONS) {
+            continue;
+        }
+        
+        // Every ring is idle: persist, then park until a client rings
+        if (dirty) {
+            saveAccounts();
+            dirty = false;
+        }
+        reapDeadClients(ringRegion);
+        ringPark(&ringRegion->doorbell, anyRequestPending, ringRegion);
+        idlePasses = 0;
+    }
+    
+    printf("\n[INFO] Daemon shutting down.\n");
+    saveAccounts();
+    
+    // Release every channel and wake its parked client so none waits on a gone daemon
+    atomic_store(&ringRegion->magic, 0);
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        atomic_store(&ringRegion->channels[c].state, CHANNEL_FREE);
+        futexWake(&ringRegion->channels[c].responses.sleeping);
+    }
+    
+    // Withdraw the region from the exporter before unmapping it
+    pthread_mutex_lock(&ringRegionLock);
+    ringRegion = NULL;
+    metricQueueDepth = NULL;
+    pthread_mutex_unlock(&ringRegionLock);
+    munmap(region, sizeof(RingRegion));
+    shm_unlink(RING_REGION_NAME);
+    close(ringRegionFd); // Unlink first so a new daemon cannot lock the old region
+    ringRegionFd = -1;
+    return SUCCESS;
+}
+
+/**
+ * Claim a channel of the given priority class in a running daemon's ring
+ * region (NULL if unavailable)
+ */
+ClientChannel *connectDaemon(PriorityClass priority) {
+    if (ringRegion == NULL) {
+        ringRegion = mapRingRegion(false);
+    }
+    if (ringRegion == NULL || !daemonAlive(ringRegion)) {
+        return NULL;
+    }
+    
+    // The channel stays CLAIMING while it is reset, so neither the daemon's
+    // passes nor reapDeadClients() act on the previous owner's pid or rings
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        ClientChannel *channel = &ringRegion->channels[c];
+        int expected = CHANNEL_FREE;
+        if (atomic_compare_exchange_strong(&channel->state, &expected, CHANNEL_CLAIMING)) {
+            channel->priority = priority;
+            channel->tokens = CLIENT_BURST;
+            channel->lastRefill = 0;
+            atomic_store(&channel->admitted, 0);
+            atomic_store(&channel->rejected, 0);
+            atomic_store(&channel->maxDepth, 0);
+            atomic_store(&channel->requests.head, 0);
+            atomic_store(&channel->requests.tail, 0);
+            atomic_store(&channel->responses.head, 0);
+            atomic_store(&channel->responses.tail, 0);
+            channel->pid = getpid();
+            atomic_store_explicit(&channel->state, CHANNEL_CLAIMED, memory_order_release);
+            return channel;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Return a channel to the daemon
+ */
+void disconnectDaemon(ClientChannel *channel) {
+    atomic_store(&channel->state, CHANNEL_FREE);
+}
+
+/**
+ * Pipeline a run of requests through the daemon. As much of the run as
+ * fits is copied into the ring and published with a single doorbell;
+ * responses are drained in order as they arrive. Returns the number of
+ * responses received, which is short only if the daemon went away.
+ */
+int callDaemonBatch(ClientChannel *channel, const Request *requests, int count, Response *responses) {
+    int sent = 0;
+    int received = 0;
+    int spin = 0;
+    
+    while (received < count) {
+        unsigned int head = atomic_load(&channel->requests.head);
+        unsigned int space = RING_CAPACITY - (head - atomic_load(&channel->requests.tail));
+        unsigned int burst = (unsigned int)(count - sent) < space ? (unsigned int)(count - sent) : space;
+        for (unsigned int i = 0; i < burst; i++) {
+            channel->requestSlots[(head + i) % RING_CAPACITY] = requests[sent + i];
+        }
+        if (burst > 0) {
+            ringPublish(&channel->requests, burst, &ringRegion->doorbell);
+            sent += burst;
+        }
+        
+        unsigned int tail = atomic_load(&channel->responses.tail);
+        unsigned int ready = atomic_load(&channel->responses.head);
+        if (tail == ready) {
+            // Spin first, park on the response ring only if the daemon takes a while
+            if (++spin >= RING_SPIN_ITERATIONS) {
+                ringPark(&channel->responses.sleeping, responsePending, channel);
+                spin = 0;
+                if (atomic_load(&channel->state) != CHANNEL_CLAIMED || !daemonAlive(ringRegion)) {
+                    break; // Daemon released the channel or died
+                }
+            }
+            continue;
+        }
+        for (; tail != ready; tail++) {
+            responses[received++] = channel->responseSlots[tail % RING_CAPACITY];
+        }
+        atomic_store(&channel->responses.tail, tail);
+        spin = 0;
+    }
+    return received;
+}
+
+/**
+ * Send one request and wait for its response
+ */
+ErrorCode callDaemon(ClientChannel *channel, const Request *request, Response *response) {
+    if (callDaemonBatch(channel, request, 1, response) != 1) {
+        return ERROR_FILE_IO;
+    }
+    return (ErrorCode)response->status;
+}
+
+/**
+ * Parse one batch line: NAME PIN deposit|withdraw AMOUNT, NAME PIN
+ * purchase CODE or NAME PIN status, each optionally followed by a
+ * transaction id that makes a resubmitted line a no-op
+ */
+static bool parseBatchRequest(const char *line, Request *request) {
+    char op[16], argument[32] = "";
+    memset(request, 0, sizeof(*request));
+    request->accountIndex = -1;
+    
+    if (sscanf(line, "%49s %d %15s %31s %llu", request->name, &request->pin, op, argument,
+               &request->transactionId) < 3) {
+        return false;
+    }
+    if (strcmp(op, "deposit") == 0 || strcmp(op, "withdraw") == 0) {
+        request->op = op[0] == 'd' ? OP_DEPOSIT : OP_WITHDRAW;
+        return sscanf(argument, "%f", &request->amount) == 1;
+    }
+    if (strcmp(op, "purchase") == 0) {
+        request->op = OP_PURCHASE;
+        request->instrument = findInstrument(argument);
+        return request->instrument >= 0;
+    }
+    if (strcmp(op, "status") == 0) {
+        request->op = OP_STATUS;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Submit every operation in a file to the daemon as one pipelined batch.
+ * Operations are applied in file order with the same checks as the
+ * interactive commands.
+ */
+ErrorCode runClientBatchFile(const char *path) {
+    FILE *file = fopen(path, "r");
     if (file == NULL) {
-        return SUCCESS; // File doesn't exist yet - not an error
+        return ERROR_FILE_IO;
+    }
+    
+    int capacity = 1024;
+    int count = 0;
+    int malformed = 0;
+    Request *requests = malloc(sizeof(Request) * capacity);
+    char line[128];
+    
+    while (requests != NULL && count < CLIENT_BATCH_LIMIT && fgets(line, sizeof(line), file) != NULL) {
+        if (count == capacity) {
+            capacity *= 2;
+            Request *grown = realloc(requests, sizeof(Request) * capacity);
+            if (grown == NULL) {
+                break;
+            }
+            requests = grown;
+        }
+        if (!parseBatchRequest(line, &requests[count])) {
+            malformed++;
+            continue;
+        }
+        requests[count].requestId = count;
+        count++;
+    }
+    fclose(file);
+    
+    Response *responses = malloc(sizeof(Response) * (count > 0 ? count : 1));
+    ClientChannel *channel = connectDaemon(PRIORITY_BATCH);
+    if (requests == NULL || responses == NULL || channel == NULL) {
+        free(requests);
+        free(responses);
+        return channel == NULL ? ERROR_FILE_IO : ERROR_INVALID_INPUT;
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int received = callDaemonBatch(channel, requests, count, responses);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    disconnectDaemon(channel);
+    
+    int rejected = 0;
+    int busy = 0;
+    for (int i = 0; i < received; i++) {
+        if (responses[i].status == ERROR_BUSY) {
+            busy++;
+        } else if (responses[i].status != SUCCESS) {
+            printf("Operation %llu rejected:", responses[i].requestId + 1);
+            displayError(responses[i].status);
+            rejected++;
+        }
+    }
+    
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("\n[INFO] Batch: %d executed, %d rejected, %d malformed line(s).\n",
+           received - rejected - busy, rejected, malformed);
+    if (busy > 0) {
+        printf("[WARNING] %d operation(s) refused as busy; resubmit them with transaction ids.\n", busy);
+    }
+    printf("[INFO] %d operation(s) in %.3f ms (%.0f ops/s).\n",
+           received, seconds * 1e3, seconds > 0 ? received / seconds : 0.0);
+    
+    free(requests);
+    free(responses);
+    return received == count ? SUCCESS : ERROR_FILE_IO;
+}
+
+/**
+ * Print a running daemon's admission and queue-depth counters
+ */
+ErrorCode printDaemonStats(void) {
+    if (ringRegion == NULL) {
+        ringRegion = mapRingRegion(false);
+    }
+    if (ringRegion == NULL || !daemonAlive(ringRegion)) {
+        return ERROR_FILE_IO;
+    }
+    
+    printf("\n=== DAEMON QUEUES ===\n");
+    printf("Queued now: %u (limit %d), shedding passes: %llu\n", atomic_load(&ringRegion->queueDepth),
+           GLOBAL_QUEUE_LIMIT, atomic_load(&ringRegion->shedPasses));
+    printf("%-8s %-8s %-12s %-8s %-12s %-12s\n", "Channel", "PID", "Class", "MaxDepth", "Admitted", "Busy");
+    for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+        ClientChannel *channel = &ringRegion->channels[c];
+        if (atomic_load(&channel->state) == CHANNEL_CLAIMED) {
+            printf("%-8d %-8d %-12s %-8u %-12llu %-12llu\n", c, (int)channel->pid,
+                   channel->priority == PRIORITY_INTERACTIVE ? "interactive" : "batch", atomic_load(&channel->maxDepth),
+                   atomic_load(&channel->admitted), atomic_load(&channel->rejected));
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Interactive client that performs cash operations through the daemon
+ */
+ErrorCode runDaemonClient(void) {
+    ClientChannel *channel = connectDaemon(PRIORITY_INTERACTIVE);
+    if (channel == NULL) {
+        printf("\n[ERROR] No daemon is running (start one with --daemon).\n");
+        return ERROR_FILE_IO;
+    }
+    
+    Request request;
+    Response response;
+    memset(&request, 0, sizeof(request));
+    
+    printf("\n=== DAEMON LOGIN ===\n");
+    printf("Enter name: ");
+    if (scanf("%49s", request.name) != 1) {
+        clearInputBuffer();
+        disconnectDaemon(channel);
+        return ERROR_INVALID_INPUT;
+    }
+    clearInputBuffer();
+    if (!getIntInput("Enter PIN: ", &request.pin)) {
+        disconnectDaemon(channel);
+        return ERROR_INVALID_INPUT;
+    }
+    
+    request.op = OP_LOGIN;
+    if (callDaemon(channel, &request, &response) != SUCCESS) {
+        disconnectDaemon(channel);
+        return ERROR_INVALID_PIN;
+    }
+    request.accountIndex = response.accountIndex;
+    printf("\n[SUCCESS] Welcome, %s!\n", request.name);
+    
+    while (true) {
+        int choice;
+        printf("\n1. Deposit\n2. Withdraw\n3. Status\n4. Logout\n");
+        if (!getIntInput("Choice: ", &choice)) {
+            displayError(ERROR_INVALID_INPUT);
+            continue;
+        }
+        if (choice == 4) {
+            break;
+        }
+        if (choice < 1 || choice > 3) {
+            displayError(ERROR_INVALID_INPUT);
+            continue;
+        }
+        
+        request.op = choice == 1 ? OP_DEPOSIT : choice == 2 ? OP_WITHDRAW : OP_STATUS;
+        if (request.op != OP_STATUS && !getFloatInput("Enter amount: $", &request.amount)) {
+            displayError(ERROR_INVALID_INPUT);
+            continue;
+        }
+        request.requestId++;
+        request.transactionId = ((unsigned long long)getpid() << 32) | request.requestId;
+        
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ErrorCode result = callDaemon(channel, &request, &response);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        if (result != SUCCESS) {
+            displayError(result);
+            continue;
+        }
+        printf("\n[SUCCESS] Balance: $%.2f  Loan: $%.2f  Holdings: $%.2f  (round trip %.2f us)\n",
+               response.balance, response.loan, response.value,
+               (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3);
+    }
+    
+    disconnectDaemon(channel);
+    return SUCCESS;
+}
+
+// ==================== MEMORY ACCOUNTING ====================
+
+static void measureStream(MemoryUsage *usage, FILE *stream) {
+    if (stream != NULL) {
+        usage->reserved += __fbufsize(stream);
+        usage->used += __fpending(stream);
+    }
+}
+
+/**
+ * Measure bytes reserved and in use by each subsystem's long-lived
+ * structures. Everything is derived from sizes the structures already
+ * keep, so nothing is counted on the hot path; a reading taken while
+ * another thread mutates state is approximate. stdio buffers are only
+ * counted when `streams` is set, since their internals may be read only
+ * by the thread that writes and closes them.
+ */
+void measureMemory(MemoryUsage usage[ALLOC_SUBSYSTEM_COUNT], bool streams) {
+    memset(usage, 0, sizeof(MemoryUsage) * ALLOC_SUBSYSTEM_COUNT);
+    
+    // Account rows, holdings columns and the hash tree over them
+    size_t perAccount = sizeof(Account) + sizeof(float) * (size_t)instrumentCount;
+    size_t treeBytes = stateTree.nodes != NULL ? 2 * (size_t)stateTree.leafCount * sizeof(unsigned long long) : 0;
+    usage[ALLOC_ACCOUNT_TABLE].reserved = tableReservation(sizeof(Account) * (size_t)accountCapacity, accountsBacking) + treeBytes;
+    for (int i = 0; i < instrumentCount; i++) {
+        usage[ALLOC_ACCOUNT_TABLE].reserved += tableReservation(sizeof(float) * (size_t)accountCapacity, holdingsBacking[i]);
+    }
+    usage[ALLOC_ACCOUNT_TABLE].used = perAccount * (size_t)accountCount + treeBytes;
+    
+    usage[ALLOC_NAME_INDEX].reserved = tableReservation(sizeof(int) * (size_t)nameIndexSize, nameIndexBacking) +
+                                       sizeof(pinTaken);
+    usage[ALLOC_NAME_INDEX].used = sizeof(int) * (size_t)indexedCount + sizeof(pinTaken);
+    
+    // Write buffers of the append-only logs
+    if (streams) {
+        measureStream(&usage[ALLOC_JOURNAL], journalFile);
+        measureStream(&usage[ALLOC_JOURNAL], postingsFile);
+        measureStream(&usage[ALLOC_JOURNAL], checkpointFile);
+        measureStream(&usage[ALLOC_JOURNAL], checkpointIndexFile);
+        measureStream(&usage[ALLOC_PERSISTENCE], dataFile);
+    }
+    
+    if (dedupe != NULL) {
+        usage[ALLOC_REQUEST_ENGINE].reserved += sizeof(DedupeWindow);
+        usage[ALLOC_REQUEST_ENGINE].used += dedupe->count * (sizeof(DedupeEntry) + 2 * sizeof(int));
+    }
+    pthread_mutex_lock(&ringRegionLock);
+    if (ringRegion != NULL) {
+        usage[ALLOC_REQUEST_ENGINE].reserved += sizeof(RingRegion);
+        for (int c = 0; c < MAX_RING_CLIENTS; c++) {
+            if (atomic_load(&ringRegion->channels[c].state) == CHANNEL_CLAIMED) {
+                usage[ALLOC_REQUEST_ENGINE].used += sizeof(ClientChannel);
+            }
+        }
+    }
+    pthread_mutex_unlock(&ringRegionLock);
+    
+    // Rate tables are fixed arrays; only the registered currencies' corner is live
+    size_t currencies = (size_t)currencyCount * (size_t)currencyCount;
+    usage[ALLOC_FOREX].reserved = sizeof(crossRates) + sizeof(directRates) + sizeof(blockedPairs) + sizeof(directQuotes);
+    usage[ALLOC_FOREX].used = currencies * (sizeof(CrossRate) + sizeof(float) + sizeof(bool)) +
+                              sizeof(DirectQuote) * (size_t)directQuoteCount;
+    
+    usage[ALLOC_DIAGNOSTICS].reserved = sizeof(metricShards);
+    usage[ALLOC_DIAGNOSTICS].used = sizeof(metricShards);
+    for (TraceBuffer *buffer = atomic_load(&traceBuffers); buffer != NULL; buffer = buffer->next) {
+        usage[ALLOC_DIAGNOSTICS].reserved += sizeof(TraceBuffer);
+        usage[ALLOC_DIAGNOSTICS].used += sizeof(TraceEvent) * (size_t)atomic_load(&buffer->count);
+    }
+    for (LogRing *ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+        usage[ALLOC_DIAGNOSTICS].reserved += sizeof(LogRing);
+        usage[ALLOC_DIAGNOSTICS].used += sizeof(LogRecord) * (atomic_load(&ring->head) - atomic_load(&ring->tail));
+    }
+    usage[ALLOC_DIAGNOSTICS].reserved += atomic_load_explicit(&logBufferBytes, memory_order_relaxed);
+}
+
+/**
+ * Print the memory table for capacity planning
+ */
+void printMemoryUsage(void) {
+    MemoryUsage usage[ALLOC_SUBSYSTEM_COUNT];
+    measureMemory(usage, true);
+    
+    size_t reserved = 0;
+    size_t used = 0;
+    printf("\n%-16s %14s %14s\n", "Subsystem", "Reserved", "Used");
+    for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++) {
+        printf("%-16s %14zu %14zu\n", ALLOC_SUBSYSTEM_NAMES[s], usage[s].reserved, usage[s].used);
+        reserved += usage[s].reserved;
+        used += usage[s].used;
+    }
+    printf("%-16s %14zu %14zu\n", "total", reserved, used);
+    if (accountCount > 0) {
+        printf("[INFO] %.1f bytes reserved per account across all subsystems.\n", (double)reserved / accountCount);
+    }
+}
+
+// ==================== METRICS EXPORT ====================
+
+/**
+ * Write every metric in the Prometheus text exposition format. Gauges over
+ * the account table are summed here, so they may straddle a concurrent
+ * update but never slow one down.
+ */
+void writeMetrics(FILE *out) {
+    fprintf(out, "# HELP bank_requests_total Requests handled by the engine, by operation and status.\n");
+    fprintf(out, "# TYPE bank_requests_total counter\n");
+    for (int op = OP_LOGIN; op <= OP_INTEREST; op++) {
+        for (int status = 0; status < METRIC_STATUSES; status++) {
+            fprintf(out, "bank_requests_total{op=\"%s\",status=\"%s\"} %llu\n", METRIC_OP_LABELS[op],
+                    METRIC_STATUS_LABELS[status], sumShards(offsetof(MetricShard, requests[op][status])));
+        }
+    }
+    
+    fprintf(out, "# HELP bank_events_total Journal events committed or rejected, by type and status.\n");
+    fprintf(out, "# TYPE bank_events_total counter\n");
+    for (int type = EVENT_ACCOUNT_CREATED; type <= EVENT_CURRENCY_CONVERSION; type++) {
+        for (int status = 0; status < METRIC_STATUSES; status++) {
+            fprintf(out, "bank_events_total{type=\"%s\",status=\"%s\"} %llu\n", METRIC_EVENT_LABELS[type],
+                    METRIC_STATUS_LABELS[status], sumShards(offsetof(MetricShard, events[type][status])));
+        }
+    }
+    
+    fprintf(out, "# HELP bank_save_duration_seconds Time taken to write the account file.\n");
+    fprintf(out, "# TYPE bank_save_duration_seconds histogram\n");
+    unsigned long long cumulative = 0;
+    for (int bucket = 0; bucket <= SAVE_LATENCY_BUCKETS; bucket++) {
+        cumulative += sumShards(offsetof(MetricShard, saveBuckets[bucket]));
+        if (bucket < SAVE_LATENCY_BUCKETS) {
+            fprintf(out, "bank_save_duration_seconds_bucket{le=\"%g\"} %llu\n",
+                    SAVE_LATENCY_BOUNDS[bucket] / 1e6, cumulative);
+        } else {
+            fprintf(out, "bank_save_duration_seconds_bucket{le=\"+Inf\"} %llu\n", cumulative);
+        }
+    }
+    fprintf(out, "bank_save_duration_seconds_sum %.6f\n", sumShards(offsetof(MetricShard, saveMicros)) / 1e6);
+    fprintf(out, "bank_save_duration_seconds_count %llu\n", cumulative);
+    
+    double balances = 0.0;
+    double loans = 0.0;
+    pthread_rwlock_rdlock(&accountTableLock);
+    int count = accountCount;
+    for (int i = 0; i < count; i++) {
+        balances += accounts[i].balance;
+        loans += accounts[i].loan;
+    }
+    pthread_rwlock_unlock(&accountTableLock);
+    
+    fprintf(out, "# HELP bank_accounts Open accounts.\n");
+    fprintf(out, "# TYPE bank_accounts gauge\n");
+    fprintf(out, "bank_accounts %d\n", count);
+    fprintf(out, "# HELP bank_balances_dollars Sum of all cash balances.\n");
+    fprintf(out, "# TYPE bank_balances_dollars gauge\n");
+    fprintf(out, "bank_balances_dollars %.2f\n", balances);
+    fprintf(out, "# HELP bank_loan_exposure_dollars Sum of all outstanding loan principal.\n");
+    fprintf(out, "# TYPE bank_loan_exposure_dollars gauge\n");
+    fprintf(out, "bank_loan_exposure_dollars %.2f\n", loans);
+    fprintf(out, "# HELP bank_queue_depth Requests queued across daemon clients at the last pass.\n");
+    fprintf(out, "# TYPE bank_queue_depth gauge\n");
+    pthread_mutex_lock(&ringRegionLock);
+    unsigned int depth = metricQueueDepth != NULL ? atomic_load(metricQueueDepth) : 0u;
+    pthread_mutex_unlock(&ringRegionLock);
+    fprintf(out, "bank_queue_depth %u\n", depth);
+    
+    // Served from the exporter thread, so stdio buffers are left out
+    MemoryUsage usage[ALLOC_SUBSYSTEM_COUNT];
+    measureMemory(usage, false);
+    fprintf(out, "# HELP bank_memory_reserved_bytes Bytes allocated or mapped by each subsystem.\n");
+    fprintf(out, "# TYPE bank_memory_reserved_bytes gauge\n");
+    for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++) {
+        fprintf(out, "bank_memory_reserved_bytes{subsystem=\"%s\"} %zu\n", ALLOC_SUBSYSTEM_NAMES[s], usage[s].reserved);
+    }
+    fprintf(out, "# HELP bank_memory_used_bytes Bytes of each subsystem's reservation holding live data.\n");
+    fprintf(out, "# TYPE bank_memory_used_bytes gauge\n");
+    for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++) {
+        fprintf(out, "bank_memory_used_bytes{subsystem=\"%s\"} %zu\n", ALLOC_SUBSYSTEM_NAMES[s], usage[s].used);
+    }
+}
+
+/**
+ * Replace the metrics file in one rename so readers never see it half written
+ */
+void writeMetricsFile(void) {
+    ALLOC_SCOPE(ALLOC_DIAGNOSTICS);
+    char temporary[PATH_MAX];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", metricsFilePath);
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL) {
+        return;
+    }
+    writeMetrics(file);
+    if (fclose(file) == 0) {
+        rename(temporary, metricsFilePath);
+    }
+}
+
+/**
+ * Answer one HTTP request on an accepted connection with the metrics page,
+ * whatever path was asked for
+ */
+static void serveMetricsRequest(int connection) {
+    ALLOC_SCOPE(ALLOC_DIAGNOSTICS);
+    char request[1024];
+    struct pollfd readable = {connection, POLLIN, 0};
+    if (poll(&readable, 1, METRICS_REQUEST_TIMEOUT_MS) <= 0 || read(connection, request, sizeof(request)) <= 0) {
+        return;
+    }
+    
+    char *body = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&body, &length);
+    if (out == NULL) {
+        return;
+    }
+    writeMetrics(out);
+    fclose(out);
+    
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                "Content-Length: %zu\r\nConnection: close\r\n\r\n", length);
+    if (write(connection, header, (size_t)headerLength) == headerLength) {
+        for (size_t sent = 0; sent < length; ) {
+            ssize_t n = write(connection, body + sent, length - sent);
+            if (n <= 0) {
+                break;
+            }
+            sent += (size_t)n;
+        }
+    }
+    free(body);
+}
+
+static void *metricsExporterMain(void *arg) {
+    int listener = (int)(intptr_t)arg;
+    long long nextWrite = 0;
+    
+    while (!atomic_load(&metricsStopping)) {
+        if (metricsFilePath != NULL && traceNow() >= nextWrite) {
+            writeMetricsFile();
+            nextWrite = traceNow() + METRICS_FILE_INTERVAL_MICROS;
+        }
+        if (listener < 0) {
+            usleep(METRICS_STOP_CHECK_MICROS);
+            continue;
+        }
+        
+        struct pollfd pending = {listener, POLLIN, 0};
+        if (poll(&pending, 1, METRICS_STOP_CHECK_MICROS / 1000) <= 0) {
+            continue;
+        }
+        int connection = accept(listener, NULL, NULL);
+        if (connection >= 0) {
+            serveMetricsRequest(connection);
+            close(connection);
+        }
+    }
+    if (listener >= 0) {
+        close(listener);
+    }
+    return NULL;
+}
+
+/**
+ * Stop the exporter, then write the metrics file a last time once no
+ * other thread can be writing it. Registered with atexit() when the
+ * exporter starts.
+ */
+void stopMetricsExporter(void) {
+    atomic_store(&metricsStopping, true);
+    pthread_join(metricsThread, NULL);
+    if (metricsFilePath != NULL) {
+        writeMetricsFile();
+    }
+}
+
+/**
+ * Start the exporter thread: it serves scrapes on 127.0.0.1:`port` (0 for
+ * none) and rewrites `file` (NULL for none) every interval and at exit
+ */
+ErrorCode startMetricsExporter(int port, const char *file) {
+    int listener = -1;
+    if (port > 0) {
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        struct sockaddr_in address = {0};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((unsigned short)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (listener < 0 ||
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(listener, METRICS_LISTEN_BACKLOG) != 0) {
+            if (listener >= 0) {
+                close(listener);
+            }
+            return ERROR_FILE_IO;
+        }
     }
-    
-    // Read account count
-    if (fread(&accountCount, sizeof(int), 1, file) != 1) {
-        fclose(file);
-        return ERROR_FILE_IO;
+    if (file != NULL) {
+        // Anchor a relative path, since the engine load test changes directory
+        static char absolute[PATH_MAX];
+        char directory[PATH_MAX / 2];
+        if (file[0] != '/' && getcwd(directory, sizeof(directory)) != NULL) {
+            snprintf(absolute, sizeof(absolute), "%s/%.*s", directory, PATH_MAX / 2 - 2, file);
+            file = absolute;
+        }
+        metricsFilePath = file;
     }
     
-    // Read all accounts
-    if (fread(accounts, sizeof(Account), accountCount, file) != (size_t)accountCount) {
-        fclose(file);
+    if (pthread_create(&metricsThread, NULL, metricsExporterMain, (void *)(intptr_t)listener) != 0) {
+        if (listener >= 0) {
+            close(listener);
+        }
         return ERROR_FILE_IO;
     }
-    
-    fclose(file);
+    atexit(stopMetricsExporter);
     return SUCCESS;
 }
 
-// ==================== ACCOUNT MANAGEMENT ====================
+// ==================== WORKLOAD GENERATION ====================
+
+static const char *const GIVEN_NAMES[] = {
+    "Olivia", "Liam", "Emma", "Noah", "Amelia", "Oliver", "Ava", "Elijah",
+    "Sophia", "Mateo", "Isabella", "Lucas", "Mia", "Levi", "Charlotte", "Ezra",
+    "Aarav", "Priya", "Chen", "Mei", "Hiroshi", "Yuki", "Fatima", "Omar",
+    "Sofia", "Diego", "Ingrid", "Lars", "Amara", "Kwame", "Zara", "Ivan"
+};
 
 /**
- * Check if account name or PIN already exists
+ * SplitMix64: small, fast and reproducible for a given seed
  */
-bool accountExists(const char *name, int pin) {
-    for (int i = 0; i < accountCount; i++) {
-        if (strcmp(accounts[i].name, name) == 0 || accounts[i].pin == pin) {
-            return true;
-        }
-    }
-    return false;
+static unsigned long long nextRandom(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double randomUnit(unsigned long long *state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
 }
 
 /**
- * Initialize a new account with default values
+ * Unique alphabetic holder name: a given name followed by the slot number
+ * spelled in base 26, so names stay valid for createAccount()
  */
-void initializeAccount(Account *account, const char *name, int pin) {
-    strncpy(account->name, name, MAX_NAME_LENGTH - 1);
-    account->name[MAX_NAME_LENGTH - 1] = '\0';
-    account->pin = pin;
-    account->balance = STARTING_BALANCE;
-    account->loan = 0.0f;
-    
-    account->assets.crypto = 0.0f;
-    account->assets.gold = 0.0f;
-    account->assets.silver = 0.0f;
-    
-    account->currencies.eur = 0.0f;
-    account->currencies.gbp = 0.0f;
-    account->currencies.inr = 0.0f;
+static void generatedName(int index, char *name) {
+    int length = snprintf(name, MAX_NAME_LENGTH, "%s", GIVEN_NAMES[index % 32]);
+    int rest = index / 32;
+    do {
+        name[length++] = (char)('a' + rest % 26);
+        rest /= 26;
+    } while (rest > 0 && length < MAX_NAME_LENGTH - 1);
+    name[length] = '\0';
 }
 
 /**
- * Create a new account
+ * Replace in-memory state with synthetic accounts. PINs are unique while
+ * the PIN range allows; balances are log-normal around the starting
+ * balance and a share of accounts carry loans, assets and foreign wallets.
  */
-ErrorCode createAccount(void) {
-    if (accountCount >= MAX_ACCOUNTS) {
-        printf("\n[ERROR] Maximum account limit reached.\n");
-        return ERROR_INVALID_INPUT;
+bool populateSyntheticAccounts(int count, unsigned long long seed) {
+    TRACE_SCOPE("populateSyntheticAccounts");
+    if (count < 0 || !ensureAccountCapacity(count)) {
+        return false;
     }
     
-    char name[MAX_NAME_LENGTH];
-    int pin;
+    // Shuffle the PIN range once; past its size PINs repeat
+    int pinRange = MAX_PIN - MIN_PIN + 1;
+    int pins[MAX_PIN - MIN_PIN + 1];
+    for (int i = 0; i < pinRange; i++) {
+        pins[i] = MIN_PIN + i;
+    }
+    for (int i = pinRange - 1; i > 0; i--) {
+        int j = (int)(nextRandom(&seed) % (unsigned long long)(i + 1));
+        int swap = pins[i];
+        pins[i] = pins[j];
+        pins[j] = swap;
+    }
     
-    // Get and validate name
-    printf("\n=== CREATE NEW ACCOUNT ===\n");
-    while (true) {
-        printf("Enter name (alphabets only): ");
-        if (scanf("%49s", name) != 1) {
-            clearInputBuffer();
-            continue;
+    accountCount = count;
+    invalidateAccountIndex();
+    for (int i = 0; i < count; i++) {
+        char name[MAX_NAME_LENGTH];
+        generatedName(i, name);
+        initializeAccount(i, name, i < pinRange ? pins[i] : MIN_PIN + (int)(nextRandom(&seed) % pinRange));
+        
+        // Box-Muller normal deviate for a log-normal balance
+        double normal = sqrt(-2.0 * log(1.0 - randomUnit(&seed))) * cos(2.0 * M_PI * randomUnit(&seed));
+        Account *account = &accounts[i];
+        account->balance = (float)(STARTING_BALANCE * exp(normal));
+        if (randomUnit(&seed) < GENERATED_LOAN_SHARE) {
+            account->loan = LOAN_AMOUNT;
+            account->balance += LOAN_AMOUNT;
         }
-        clearInputBuffer();
         
-        if (isAlphaString(name)) {
-            break;
+        for (int id = 0; id < instrumentCount; id++) {
+            double share = instruments[id].kind == INSTRUMENT_ASSET ? GENERATED_ASSET_SHARE : GENERATED_WALLET_SHARE;
+            if (randomUnit(&seed) < share) {
+                int lots = 1 + (int)(nextRandom(&seed) % 10);
+                holdings[id][i] = lots * ASSET_PURCHASE_AMOUNT / instrumentPrices[id];
+            }
         }
-        printf("[ERROR] Name must contain only alphabetic characters.\n");
     }
     
-    // Get and validate PIN
-    while (true) {
-        if (!getIntInput("Set 4-digit PIN (1000-9999): ", &pin)) {
-            printf("[ERROR] Invalid PIN format.\n");
-            continue;
-        }
-        
-        if (isValidPIN(pin)) {
-            break;
+    merkleRebuild(&stateTree);
+    return true;
+}
+
+/**
+ * Write a data file of synthetic accounts. The file belongs in a fresh
+ * directory: its header carries journal sequence 0, so a journal or
+ * postings log already next to it would be replayed over the generated
+ * accounts on the next start. Such a directory is refused.
+ */
+ErrorCode generateAccounts(int count, const char *path, unsigned long long seed) {
+    static const char *const logFiles[] = {JOURNAL_FILE, POSTINGS_FILE};
+    const char *slash = strrchr(path, '/');
+    int directoryLength = slash != NULL ? (int)(slash - path) + 1 : 0;
+    for (size_t i = 0; i < sizeof(logFiles) / sizeof(logFiles[0]); i++) {
+        char logPath[PATH_MAX];
+        snprintf(logPath, sizeof(logPath), "%.*s%s", directoryLength, path, logFiles[i]);
+        if (access(logPath, F_OK) == 0) {
+            printf("\n[ERROR] %s already exists; generate accounts into a directory without a journal.\n", logPath);
+            return ERROR_INVALID_INPUT;
         }
-        printf("[ERROR] PIN must be between 1000 and 9999.\n");
     }
     
-    // Check for duplicates
-    if (accountExists(name, pin)) {
-        return ERROR_ACCOUNT_EXISTS;
+    if (!populateSyntheticAccounts(count, seed)) {
+        return ERROR_INVALID_INPUT;
     }
     
-    // Create and save account
-    initializeAccount(&accounts[accountCount], name, pin);
-    accountCount++;
-    
-    ErrorCode result = saveAccounts();
-    if (result == SUCCESS) {
-        printf("\n[SUCCESS] Account created successfully!\n");
-        printf("Starting balance: $%.2f\n", STARTING_BALANCE);
+    int pinRange = MAX_PIN - MIN_PIN + 1;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return ERROR_FILE_IO;
     }
+    bool written = writeSnapshot(file);
+    fclose(file);
     
-    return result;
+    printf("\n[INFO] Wrote %d synthetic account(s) to %s%s.\n", count, path,
+           count > pinRange ? " (PIN range exhausted; later PINs repeat)" : "");
+    return written ? SUCCESS : ERROR_FILE_IO;
 }
 
 /**
- * Authenticate user login
+ * Parse an operation mix such as "deposit=50,withdraw=30" into weights
+ * indexed by RequestOp
  */
-ErrorCode loginAccount(void) {
-    char name[MAX_NAME_LENGTH];
-    int pin;
+static bool parseWorkloadMix(const char *mix, double weights[OP_INTEREST + 1]) {
+    static const struct { const char *name; RequestOp op; } names[] = {
+        {"login", OP_LOGIN}, {"deposit", OP_DEPOSIT}, {"withdraw", OP_WITHDRAW}, {"purchase", OP_PURCHASE},
+        {"loan", OP_LOAN}, {"fx", OP_CONVERT}, {"status", OP_STATUS}
+    };
+    double total = 0.0;
+    memset(weights, 0, sizeof(double) * (OP_INTEREST + 1));
     
-    printf("\n=== LOGIN ===\n");
-    printf("Enter name: ");
-    if (scanf("%49s", name) != 1) {
-        clearInputBuffer();
-        return ERROR_INVALID_INPUT;
-    }
-    clearInputBuffer();
-    
-    if (!getIntInput("Enter PIN: ", &pin)) {
-        return ERROR_INVALID_INPUT;
-    }
-    
-    // Search for matching account
-    for (int i = 0; i < accountCount; i++) {
-        if (strcmp(accounts[i].name, name) == 0 && accounts[i].pin == pin) {
-            currentUserIndex = i;
-            printf("\n[SUCCESS] Welcome, %s!\n", name);
-            return SUCCESS;
+    while (*mix != '\0') {
+        char name[16];
+        double weight;
+        int consumed;
+        if (sscanf(mix, "%15[a-z]=%lf%n", name, &weight, &consumed) != 2 || weight < 0) {
+            return false;
+        }
+        
+        size_t n = 0;
+        while (n < sizeof(names) / sizeof(names[0]) && strcmp(names[n].name, name) != 0) {
+            n++;
+        }
+        if (n == sizeof(names) / sizeof(names[0])) {
+            return false;
+        }
+        weights[names[n].op] = weight;
+        total += weight;
+        
+        mix += consumed;
+        if (*mix == ',') {
+            mix++;
         }
     }
-    
-    printf("\n[ERROR] Login failed. Invalid credentials.\n");
-    return ERROR_INVALID_PIN;
+    return total > 0.0;
 }
 
 /**
- * Verify PIN for current user
+ * Draw an operation from mix weights summing to `total`
  */
-bool verifyPIN(void) {
-    int pin;
-    if (!getIntInput("Enter PIN for verification: ", &pin)) {
-        return false;
+static int pickOperation(const double weights[OP_INTEREST + 1], double total, unsigned long long *seed) {
+    double pick = randomUnit(seed) * total;
+    int op = OP_LOGIN;
+    while (op < OP_INTEREST && pick >= weights[op]) {
+        pick -= weights[op];
+        op++;
     }
-    return (pin == accounts[currentUserIndex].pin);
+    return op;
 }
 
-// ==================== MARKET OPERATIONS ====================
-
 /**
- * Update market prices with realistic fluctuations
+ * Prepare a Zipf sampler over `count` accounts with the given exponent
  */
-void updateMarketPrices(void) {
-    // Crypto: volatile (-15% to +20%)
-    float cryptoChange = ((rand() % 35) - 15) / 100.0f;
-    marketPrices.crypto *= (1.0f + cryptoChange);
-    
-    // Gold: stable (-5% to +10%)
-    float goldChange = ((rand() % 15) - 5) / 100.0f;
-    marketPrices.gold *= (1.0f + goldChange);
-    
-    // Silver: moderate (-10% to +15%)
-    float silverChange = ((rand() % 25) - 10) / 100.0f;
-    marketPrices.silver *= (1.0f + silverChange);
+bool zipfInit(ZipfSampler *sampler, int count, double skew, unsigned long long *seed) {
+    ALLOC_SCOPE(ALLOC_WORKLOAD);
+    sampler->count = count;
+    sampler->cdf = malloc(sizeof(double) * (size_t)(count > 0 ? count : 1));
+    sampler->slotOfRank = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+    if (sampler->cdf == NULL || sampler->slotOfRank == NULL || count <= 0) {
+        return false;
+    }
     
-    printf("\n=== MARKET UPDATE ===\n");
-    printf("Crypto:  $%.2f (%.2f%%)\n", marketPrices.crypto, cryptoChange * 100);
-    printf("Gold:    $%.2f (%.2f%%)\n", marketPrices.gold, goldChange * 100);
-    printf("Silver:  $%.2f (%.2f%%)\n", marketPrices.silver, silverChange * 100);
+    double sum = 0.0;
+    for (int rank = 0; rank < count; rank++) {
+        sum += 1.0 / pow(rank + 1, skew);
+        sampler->cdf[rank] = sum;
+        sampler->slotOfRank[rank] = rank;
+    }
+    for (int i = count - 1; i > 0; i--) {
+        int j = (int)(nextRandom(seed) % (unsigned long long)(i + 1));
+        int swap = sampler->slotOfRank[i];
+        sampler->slotOfRank[i] = sampler->slotOfRank[j];
+        sampler->slotOfRank[j] = swap;
+    }
+    return true;
 }
 
 /**
- * Display current market prices
+ * Pick an account slot: binary search for the rank whose cumulative
+ * weight covers a uniform draw
  */
-void displayMarketPrices(void) {
-    printf("\n=== CURRENT MARKET PRICES ===\n");
-    printf("Cryptocurrency: $%.2f per unit\n", marketPrices.crypto);
-    printf("Gold:           $%.2f per unit\n", marketPrices.gold);
-    printf("Silver:         $%.2f per unit\n", marketPrices.silver);
-    printf("============================\n");
+int zipfNext(const ZipfSampler *sampler, unsigned long long *seed) {
+    double draw = randomUnit(seed) * sampler->cdf[sampler->count - 1];
+    int low = 0, high = sampler->count - 1;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (sampler->cdf[middle] < draw) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return sampler->slotOfRank[low];
 }
 
-// ==================== BANKING OPERATIONS ====================
+void zipfFree(ZipfSampler *sampler) {
+    free(sampler->cdf);
+    free(sampler->slotOfRank);
+    sampler->cdf = NULL;
+    sampler->slotOfRank = NULL;
+}
 
 /**
- * Handle cash deposit
+ * Write a reproducible operation stream in the --client-batch format over
+ * the accounts of a data file. Accounts are drawn from a Zipf distribution
+ * (hot ranks shuffled across slots) and every line carries a transaction
+ * id so a resubmitted stream is deduplicated. The seed fills the id's high
+ * half, so streams generated with different seeds never collide.
  */
-ErrorCode depositCash(float amount) {
-    if (amount <= 0) {
-        return ERROR_INVALID_INPUT;
+ErrorCode generateWorkload(const char *dataPath, long operations, const char *path,
+                           const char *mix, double skew, unsigned long long seed) {
+    double weights[OP_INTEREST + 1];
+    if (operations < 0 || !parseWorkloadMix(mix, weights) ||
+        weights[OP_LOGIN] > 0 || weights[OP_LOAN] > 0 || weights[OP_CONVERT] > 0) {
+        return ERROR_INVALID_INPUT; // Batch files only carry cash, purchase and status lines
     }
     
-    accounts[currentUserIndex].balance += amount;
-    printf("\n[SUCCESS] Deposited $%.2f\n", amount);
-    printf("New balance: $%.2f\n", accounts[currentUserIndex].balance);
-    
-    return saveAccounts();
-}
-
-/**
- * Handle cash withdrawal
- */
-ErrorCode withdrawCash(float amount) {
-    if (amount <= 0) {
+    FILE *data = fopen(dataPath, "rb");
+    if (data == NULL || !readSnapshot(data)) {
+        if (data != NULL) {
+            fclose(data);
+        }
+        return ERROR_FILE_IO;
+    }
+    fclose(data);
+    if (accountCount == 0) {
         return ERROR_INVALID_INPUT;
     }
     
-    if (amount > accounts[currentUserIndex].balance) {
-        return ERROR_INSUFFICIENT_FUNDS;
+    const unsigned long long streamSeed = seed; // The sampler advances `seed`
+    ZipfSampler sampler;
+    int assets[MAX_INSTRUMENTS];
+    int assetCount = 0;
+    FILE *file = zipfInit(&sampler, accountCount, skew, &seed) ? fopen(path, "w") : NULL;
+    if (file == NULL) {
+        zipfFree(&sampler);
+        return ERROR_FILE_IO;
     }
     
-    if (!verifyPIN()) {
-        return ERROR_INVALID_PIN;
+    for (int id = 0; id < instrumentCount; id++) {
+        if (instruments[id].kind == INSTRUMENT_ASSET) {
+            assets[assetCount++] = id;
+        }
     }
     
-    accounts[currentUserIndex].balance -= amount;
-    printf("\n[SUCCESS] Withdrawn $%.2f\n", amount);
-    printf("New balance: $%.2f\n", accounts[currentUserIndex].balance);
+    double mixTotal = 0.0;
+    for (int op = 0; op <= OP_INTEREST; op++) {
+        mixTotal += weights[op];
+    }
     
-    return saveAccounts();
+    const unsigned long long stream = streamSeed << 32;
+    for (long n = 0; n < operations; n++) {
+        const Account *account = &accounts[zipfNext(&sampler, &seed)];
+        int op = pickOperation(weights, mixTotal, &seed);
+        
+        fprintf(file, "%s %d ", account->name, account->pin);
+        if (op == OP_DEPOSIT || op == OP_WITHDRAW) {
+            fprintf(file, "%s %.2f", op == OP_DEPOSIT ? "deposit" : "withdraw",
+                    1.0 + randomUnit(&seed) * (op == OP_DEPOSIT ? 499.0 : 199.0));
+        } else if (op == OP_PURCHASE && assetCount > 0) {
+            fprintf(file, "purchase %s", instruments[assets[nextRandom(&seed) % assetCount]].code);
+        } else {
+            fprintf(file, "status -");
+        }
+        fprintf(file, " %llu\n", stream | (unsigned long long)(n + 1));
+    }
+    
+    bool written = fclose(file) == 0;
+    zipfFree(&sampler);
+    printf("\n[INFO] Wrote %ld operation(s) over %d account(s) to %s (skew %.2f).\n",
+           operations, accountCount, path, skew);
+    return written ? SUCCESS : ERROR_FILE_IO;
+}
+
+// ==================== LOAD GENERATION ====================
+
+static pthread_mutex_t engineLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool loadRunning;
+static double loadWeights[OP_INTEREST + 1];
+static double loadMixTotal;
+static ZipfSampler loadSampler;
+
+static int latencyBucket(unsigned long long nanos) {
+    if (nanos < LATENCY_SUB_BUCKETS) {
+        return (int)nanos;
+    }
+    int exponent = 63 - __builtin_clzll(nanos);
+    int sub = (int)((nanos >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1));
+    int bucket = (exponent - 3) * LATENCY_SUB_BUCKETS + sub;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+static unsigned long long latencyBucketUpper(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return (unsigned long long)bucket;
+    }
+    int exponent = bucket / LATENCY_SUB_BUCKETS + 3;
+    unsigned long long sub = (unsigned long long)(bucket % LATENCY_SUB_BUCKETS);
+    return (1ULL << exponent) + ((sub + 1) << (exponent - 4)) - 1;
 }
 
 /**
- * Process cash transactions (deposit/withdraw)
+ * Latency in microseconds below which `fraction` of the recorded samples fall
  */
-void processCashTransaction(void) {
-    int choice;
-    float amount;
-    
-    printf("\n=== CASH TRANSACTION ===\n");
-    printf("1. Deposit\n");
-    printf("2. Withdraw\n");
-    
-    if (!getIntInput("Choice: ", &choice)) {
-        displayError(ERROR_INVALID_INPUT);
-        return;
-    }
-    
-    if (!getFloatInput("Enter amount: $", &amount)) {
-        displayError(ERROR_INVALID_INPUT);
-        return;
+static double latencyPercentile(const unsigned long long *counts, unsigned long long total, double fraction) {
+    unsigned long long target = (unsigned long long)ceil(total * fraction);
+    unsigned long long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= target && counts[b] > 0) {
+            return latencyBucketUpper(b) / 1e3;
+        }
     }
+    return 0.0;
+}
+
+static unsigned long long monotonicNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * Fill in one random request of the configured mix for a Zipf-chosen account
+ */
+static void buildLoadRequest(Request *request, unsigned long long *seed) {
+    int index = zipfNext(&loadSampler, seed);
+    memset(request, 0, sizeof(*request));
+    request->op = pickOperation(loadWeights, loadMixTotal, seed);
+    request->accountIndex = index;
+    request->pin = accounts[index].pin;
     
-    ErrorCode result;
-    if (choice == 1) {
-        result = depositCash(amount);
-    } else if (choice == 2) {
-        result = withdrawCash(amount);
-    } else {
-        displayError(ERROR_INVALID_INPUT);
-        return;
+    switch (request->op) {
+        case OP_LOGIN:
+            snprintf(request->name, sizeof(request->name), "%s", accounts[index].name);
+            break;
+        case OP_DEPOSIT:
+        case OP_WITHDRAW:
+            request->amount = (float)(1.0 + randomUnit(seed) * 199.0);
+            break;
+        case OP_PURCHASE:
+            do {
+                request->instrument = (int)(nextRandom(seed) % (unsigned long long)instrumentCount);
+            } while (instruments[request->instrument].kind != INSTRUMENT_ASSET);
+            break;
+        case OP_CONVERT:
+            request->instrument = BASE_CURRENCY;
+            request->counterInstrument = currencyCount > 1 ? 1 + (int)(nextRandom(seed) % (currencyCount - 1)) : 0;
+            request->amount = (float)(10.0 + randomUnit(seed) * 90.0);
+            break;
+        default:
+            break;
     }
+}
+
+/**
+ * One simulated client: issue a request, wait for the answer, record the
+ * latency, then pause until its next scheduled send. When paced, latency
+ * runs from the scheduled send time, so a stall is charged to every
+ * request it delayed rather than only the one in flight.
+ */
+static void *loadClientMain(void *argument) {
+    LoadClient *client = argument;
+    unsigned long long next = monotonicNanos();
+    Request request;
+    Response response;
     
-    if (result != SUCCESS) {
-        displayError(result);
+    for (unsigned long long sent = 0; atomic_load(&loadRunning); sent++) {
+        buildLoadRequest(&request, &client->seed);
+        request.requestId = sent;
+        
+        unsigned long long start = client->intervalNanos > 0 ? next : monotonicNanos();
+        ErrorCode result;
+        if (client->channel != NULL) {
+            result = callDaemon(client->channel, &request, &response);
+        } else {
+            pthread_mutex_lock(&engineLock);
+            result = executeRequest(&request, &response);
+            pthread_mutex_unlock(&engineLock);
+        }
+        unsigned long long end = monotonicNanos();
+        
+        atomic_fetch_add_explicit(&client->interval.buckets[latencyBucket(end - start)], 1, memory_order_relaxed);
+        if (result == ERROR_BUSY) {
+            atomic_fetch_add_explicit(&client->busy, 1, memory_order_relaxed);
+        } else if (result != SUCCESS) {
+            atomic_fetch_add_explicit(&client->failed, 1, memory_order_relaxed);
+        }
+        
+        // Pace to the target rate; after a stall the overdue sends go out back to back
+        if (client->intervalNanos > 0) {
+            next += (unsigned long long)client->intervalNanos;
+            if (next > end) {
+                struct timespec pause = {(time_t)((next - end) / 1000000000ULL), (long)((next - end) % 1000000000ULL)};
+                nanosleep(&pause, NULL);
+            }
+        }
     }
+    return NULL;
 }
 
 /**
- * Purchase assets (crypto, gold, silver)
+ * Run closed-loop simulated clients against the daemon or the in-process
+ * engine for a number of seconds, printing throughput and latency
+ * percentiles every second and for the whole run. A rate of 0 lets each
+ * client send its next request as soon as the previous one completes.
+ * The engine runs on the loaded accounts but journals to scratch files,
+ * so the live data files are left as they were.
  */
-void purchaseAsset(void) {
-    Account *user = &accounts[currentUserIndex];
+ErrorCode runLoadTest(bool viaDaemon, int clients, int seconds, double rate, const char *mix, double skew) {
+    ALLOC_SCOPE(ALLOC_WORKLOAD);
+    if (clients <= 0 || seconds <= 0 || rate < 0 || accountCount == 0 ||
+        (viaDaemon && clients > MAX_RING_CLIENTS) || (!viaDaemon && sharedStore != NULL) ||
+        !parseWorkloadMix(mix, loadWeights)) {
+        return ERROR_INVALID_INPUT; // A shared store would carry the test into other processes
+    }
     
-    if (user->balance < ASSET_PURCHASE_AMOUNT) {
-        displayError(ERROR_INSUFFICIENT_FUNDS);
-        return;
+    char directory[] = "/tmp/bank-load-XXXXXX";
+    int previous = -1;
+    if (!viaDaemon) {
+        closeStateFiles();
+        previous = enterScratchDirectory(directory);
+        if (previous < 0) {
+            return ERROR_FILE_IO;
+        }
+        if (openJournal(SNAPSHOT_SEQUENCE_UNKNOWN) != SUCCESS) {
+            removeScratchDirectory(directory, previous);
+            return ERROR_FILE_IO;
+        }
+    }
+    loadMixTotal = 0.0;
+    for (int op = 0; op <= OP_INTEREST; op++) {
+        loadMixTotal += loadWeights[op];
     }
     
-    if (!verifyPIN()) {
-        displayError(ERROR_INVALID_PIN);
-        return;
+    unsigned long long seed = 1;
+    LoadClient *pool = calloc((size_t)clients, sizeof(LoadClient));
+    unsigned long long *counts = calloc(LATENCY_BUCKETS, sizeof(unsigned long long));
+    unsigned long long *totals = calloc(LATENCY_BUCKETS, sizeof(unsigned long long));
+    if (pool == NULL || counts == NULL || totals == NULL || !zipfInit(&loadSampler, accountCount, skew, &seed)) {
+        free(pool);
+        free(counts);
+        free(totals);
+        zipfFree(&loadSampler);
+        if (!viaDaemon) {
+            removeScratchDirectory(directory, previous);
+        }
+        return ERROR_INVALID_INPUT;
+    }
+    
+    // Channels are claimed here so the region is mapped once, before any thread runs
+    int started = 0;
+    atomic_store(&loadRunning, true);
+    for (; started < clients; started++) {
+        LoadClient *client = &pool[started];
+        client->id = started;
+        client->seed = 0x5eed0000ULL + (unsigned long long)started;
+        client->intervalNanos = rate > 0 ? 1e9 * clients / rate : 0.0;
+        client->channel = viaDaemon ? connectDaemon(PRIORITY_INTERACTIVE) : NULL;
+        if ((viaDaemon && client->channel == NULL) ||
+            pthread_create(&client->thread, NULL, loadClientMain, client) != 0) {
+            break;
+        }
+    }
+    
+    printf("\n=== LOAD TEST: %d client(s) via %s, %ds ===\n", started, viaDaemon ? "daemon" : "engine", seconds);
+    printf("%-5s %-12s %-10s %-10s %-10s %-10s %-8s %-8s\n",
+           "Sec", "Ops/s", "p50(us)", "p99(us)", "p99.9(us)", "Max(us)", "Busy", "Failed");
+    
+    unsigned long long grandTotal = 0, busyTotal = 0, failedTotal = 0;
+    for (int second = 1; second <= seconds && started == clients; second++) {
+        struct timespec pause = {1, 0};
+        nanosleep(&pause, NULL);
+        
+        unsigned long long total = 0, busy = 0, failed = 0;
+        memset(counts, 0, sizeof(unsigned long long) * LATENCY_BUCKETS);
+        for (int c = 0; c < started; c++) {
+            for (int b = 0; b < LATENCY_BUCKETS; b++) {
+                counts[b] += atomic_exchange_explicit(&pool[c].interval.buckets[b], 0, memory_order_relaxed);
+            }
+            busy += atomic_exchange(&pool[c].busy, 0);
+            failed += atomic_exchange(&pool[c].failed, 0);
+        }
+        int highest = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            total += counts[b];
+            totals[b] += counts[b];
+            highest = counts[b] > 0 ? b : highest;
+        }
+        grandTotal += total;
+        busyTotal += busy;
+        failedTotal += failed;
+        
+        printf("%-5d %-12llu %-10.1f %-10.1f %-10.1f %-10.1f %-8llu %-8llu\n", second, total,
+               latencyPercentile(counts, total, 0.50), latencyPercentile(counts, total, 0.99),
+               latencyPercentile(counts, total, 0.999), latencyBucketUpper(highest) / 1e3, busy, failed);
+        fflush(stdout);
     }
     
-    printf("\n=== PURCHASE ASSET ===\n");
-    printf("Investment amount: $%.2f\n\n", ASSET_PURCHASE_AMOUNT);
-    printf("1. Cryptocurrency ($%.2f/unit)\n", marketPrices.crypto);
-    printf("2. Gold           ($%.2f/unit)\n", marketPrices.gold);
-    printf("3. Silver         ($%.2f/unit)\n", marketPrices.silver);
-    
-    int choice;
-    if (!getIntInput("\nChoice: ", &choice)) {
-        displayError(ERROR_INVALID_INPUT);
-        return;
+    atomic_store(&loadRunning, false);
+    for (int c = 0; c < started; c++) {
+        pthread_join(pool[c].thread, NULL);
+        if (pool[c].channel != NULL) {
+            disconnectDaemon(pool[c].channel);
+        }
     }
     
-    user->balance -= ASSET_PURCHASE_AMOUNT;
-    float units = ASSET_PURCHASE_AMOUNT;
-    
-    switch (choice) {
-        case 1:
-            units /= marketPrices.crypto;
-            user->assets.crypto += units;
-            printf("\n[SUCCESS] Purchased %.4f units of Cryptocurrency\n", units);
-            break;
-        case 2:
-            units /= marketPrices.gold;
-            user->assets.gold += units;
-            printf("\n[SUCCESS] Purchased %.4f units of Gold\n", units);
-            break;
-        case 3:
-            units /= marketPrices.silver;
-            user->assets.silver += units;
-            printf("\n[SUCCESS] Purchased %.4f units of Silver\n", units);
-            break;
-        default:
-            user->balance += ASSET_PURCHASE_AMOUNT; // Refund
-            displayError(ERROR_INVALID_INPUT);
-            return;
+    bool completed = started == clients;
+    if (completed) {
+        printf("\n[INFO] %.0f ops/s sustained; p50 %.1f us, p99 %.1f us, p99.9 %.1f us; %llu busy, %llu failed.\n",
+               (double)grandTotal / seconds, latencyPercentile(totals, grandTotal, 0.50),
+               latencyPercentile(totals, grandTotal, 0.99), latencyPercentile(totals, grandTotal, 0.999),
+               busyTotal, failedTotal);
+    }
+    if (!viaDaemon) {
+        removeScratchDirectory(directory, previous);
     }
     
-    printf("Remaining balance: $%.2f\n", user->balance);
-    saveAccounts();
+    free(pool);
+    free(counts);
+    free(totals);
+    zipfFree(&loadSampler);
+    return completed ? SUCCESS : ERROR_FILE_IO;
 }
 
+// ==================== BENCHMARKS ====================
+
+static const char *const BENCH_PATH_NAMES[BENCH_PATH_COUNT] = {
+    "login_lookup", "account_exists", "deposit", "save_accounts", "interest_batch", "revaluation"
+};
+
 /**
- * Manage loan (take or repay)
+ * Run a worker's slice of one code path. Lookups and revaluation only
+ * read state and run in parallel; deposits and interest mutate it through
+ * commitEvent() and so serialise on the engine lock as they would in
+ * the daemon.
  */
-void manageLoan(void) {
-    Account *user = &accounts[currentUserIndex];
+static void *benchWorkerMain(void *argument) {
+    TRACE_SCOPE("benchWorker");
+    BenchWorker *worker = argument;
     
-    if (!verifyPIN()) {
-        displayError(ERROR_INVALID_PIN);
-        return;
+    for (int n = worker->first; n < worker->last; n++) {
+        int index = (int)(nextRandom(&worker->seed) % (unsigned long long)accountCount);
+        switch (worker->path) {
+            case BENCH_LOGIN_LOOKUP:
+                worker->checksum += findAccount(accounts[index].name);
+                break;
+            case BENCH_ACCOUNT_EXISTS:
+                worker->checksum += accountExists(accounts[index].name, accounts[index].pin);
+                break;
+            case BENCH_DEPOSIT: {
+                Event event = makeEvent(EVENT_DEPOSIT, index);
+                event.amount = 1.0f;
+                event.balanceDelta = 1.0f;
+                pthread_mutex_lock(&engineLock);
+                worker->checksum += commitEvent(&event);
+                pthread_mutex_unlock(&engineLock);
+                break;
+            }
+            case BENCH_INTEREST_BATCH: {
+                Event event = makeEvent(EVENT_INTEREST, n);
+                pthread_mutex_lock(&engineLock);
+                event.amount = accounts[n].balance * INTEREST_RATE;
+                event.balanceDelta = event.amount;
+                worker->checksum += commitEvent(&event);
+                pthread_mutex_unlock(&engineLock);
+                break;
+            }
+            case BENCH_REVALUATION: {
+                float totals[INSTRUMENT_KIND_COUNT];
+                valueHoldings(n, totals);
+                worker->checksum += totals[INSTRUMENT_ASSET] + totals[INSTRUMENT_CURRENCY];
+                break;
+            }
+            default:
+                break;
+        }
     }
+    return NULL;
+}
+
+/**
+ * Time one code path at the current account count. Passes over every
+ * account split the table between workers; the rest share a fixed number
+ * of random operations. Returns elapsed seconds (negative on error).
+ */
+static double benchMeasure(int path, int threads, int operations) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     
-    printf("\n=== LOAN MANAGEMENT ===\n");
-    
-    if (user->loan == 0) {
-        printf("You have no outstanding loan.\n");
-        printf("Would you like to take a loan of $%.2f? (1=Yes, 0=No): ", LOAN_AMOUNT);
-        
-        int confirm;
-        if (!getIntInput("", &confirm) || confirm != 1) {
-            printf("Loan request cancelled.\n");
-            return;
+    if (path == BENCH_SAVE) {
+        FILE *file = fopen(BENCH_SNAPSHOT_FILE, "wb");
+        bool written = file != NULL && writeSnapshot(file);
+        if (file != NULL) {
+            fclose(file);
+        }
+        remove(BENCH_SNAPSHOT_FILE);
+        if (!written) {
+            return -1.0;
         }
-        
-        user->loan = LOAN_AMOUNT;
-        user->balance += LOAN_AMOUNT;
-        printf("\n[SUCCESS] Loan of $%.2f approved!\n", LOAN_AMOUNT);
-        printf("New balance: $%.2f\n", user->balance);
     } else {
-        printf("Outstanding loan: $%.2f\n", user->loan);
-        printf("Current balance: $%.2f\n", user->balance);
-        
-        if (user->balance >= user->loan) {
-            printf("Repay full loan? (1=Yes, 0=No): ");
-            
-            int confirm;
-            if (!getIntInput("", &confirm) || confirm != 1) {
-                printf("Repayment cancelled.\n");
-                return;
+        BenchWorker workers[threads];
+        int started = 0;
+        for (; started < threads; started++) {
+            workers[started] = (BenchWorker){0};
+            workers[started].path = path;
+            workers[started].first = (int)((long long)operations * started / threads);
+            workers[started].last = (int)((long long)operations * (started + 1) / threads);
+            workers[started].seed = 0xbe9c0000ULL + (unsigned long long)started;
+            if (pthread_create(&workers[started].thread, NULL, benchWorkerMain, &workers[started]) != 0) {
+                break;
             }
-            
-            user->balance -= user->loan;
-            user->loan = 0;
-            printf("\n[SUCCESS] Loan fully repaid!\n");
-            printf("Remaining balance: $%.2f\n", user->balance);
-        } else {
-            printf("\n[INFO] Insufficient funds to repay loan.\n");
-            return;
+        }
+        for (int t = 0; t < started; t++) {
+            pthread_join(workers[t].thread, NULL);
+        }
+        if (started < threads) {
+            return -1.0;
         }
     }
     
-    saveAccounts();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 }
 
 /**
- * Add interest to account balance
+ * Sweep account counts by powers of ten up to maxAccounts and worker
+ * counts by powers of two up to every core, timing each main code path,
+ * and print the results as CSV or JSON. Runs on synthetic in-memory state
+ * with the journal closed, so live data files are never touched.
  */
-void addInterest(void) {
-    Account *user = &accounts[currentUserIndex];
-    float interest = user->balance * INTEREST_RATE;
+ErrorCode runBenchmarks(int maxAccounts, bool json) {
+    ALLOC_SCOPE(ALLOC_WORKLOAD);
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxAccounts < 100 || maxAccounts > MAX_ACCOUNTS || cores < 1 || journalFile != NULL) {
+        return ERROR_INVALID_INPUT;
+    }
     
-    user->balance += interest;
+    int threadCounts[32];
+    int threadSteps = 0;
+    for (int threads = 1; threads < cores && threadSteps < 31; threads *= 2) {
+        threadCounts[threadSteps++] = threads;
+    }
+    threadCounts[threadSteps++] = cores;
     
-    printf("\n=== INTEREST PAYMENT ===\n");
-    printf("Interest rate: %.1f%%\n", INTEREST_RATE * 100);
-    printf("Interest earned: $%.2f\n", interest);
-    printf("New balance: $%.2f\n", user->balance);
+    bool first = true;
+    printf(json ? "[\n" : "accounts,threads,path,operations,seconds,ops_per_sec,ns_per_op\n");
     
-    saveAccounts();
+    for (long long count = 100; count <= maxAccounts; count *= 10) {
+        for (int step = 0; step < threadSteps; step++) {
+            for (int path = 0; path < BENCH_PATH_COUNT; path++) {
+                // Saving is single-threaded; time it once per account count
+                if (path == BENCH_SAVE && step > 0) {
+                    continue;
+                }
+                
+                // Start every measurement from the same state
+                if (!populateSyntheticAccounts((int)count, 1)) {
+                    return ERROR_INVALID_INPUT;
+                }
+                findAccount(""); // Build the name index outside the timed region
+                
+                int operations = path == BENCH_SAVE ? 1
+                                 : path == BENCH_INTEREST_BATCH || path == BENCH_REVALUATION ? (int)count
+                                 : (count > BENCH_MIN_OPERATIONS ? (int)count : BENCH_MIN_OPERATIONS);
+                int threads = path == BENCH_SAVE ? 1 : threadCounts[step];
+                double seconds = benchMeasure(path, threads, operations);
+                if (seconds < 0) {
+                    return ERROR_FILE_IO;
+                }
+                
+                double rate = seconds > 0 ? operations / seconds : 0.0;
+                double nanos = seconds * 1e9 / operations;
+                if (json) {
+                    printf("%s  {\"accounts\": %lld, \"threads\": %d, \"path\": \"%s\", \"operations\": %d, "
+                           "\"seconds\": %.6f, \"ops_per_sec\": %.0f, \"ns_per_op\": %.1f}",
+                           first ? "" : ",\n", count, threads, BENCH_PATH_NAMES[path], operations,
+                           seconds, rate, nanos);
+                } else {
+                    printf("%lld,%d,%s,%d,%.6f,%.0f,%.1f\n", count, threads, BENCH_PATH_NAMES[path],
+                           operations, seconds, rate, nanos);
+                }
+                first = false;
+                fflush(stdout);
+            }
+        }
+    }
+    
+    if (json) {
+        printf("\n]\n");
+    }
+    return SUCCESS;
 }
 
+// ==================== ALLOCATION CHECK ====================
+
 /**
- * Display comprehensive account status
+ * Print calls and bytes charged to each subsystem and operation
  */
-void displayAccountStatus(void) {
-    Account *user = &accounts[currentUserIndex];
-    
-    // Calculate asset values
-    float cryptoValue = user->assets.crypto * marketPrices.crypto;
-    float goldValue = user->assets.gold * marketPrices.gold;
-    float silverValue = user->assets.silver * marketPrices.silver;
-    float totalAssets = cryptoValue + goldValue + silverValue;
-    
-    // Calculate forex values
-    float eurValue = user->currencies.eur * exchangeRates.eur;
-    float gbpValue = user->currencies.gbp * exchangeRates.gbp;
-    float inrValue = user->currencies.inr * exchangeRates.inr;
-    float totalForex = eurValue + gbpValue + inrValue;
-    
-    // Calculate net worth
-    float netWorth = user->balance + totalAssets + totalForex - user->loan;
-    
-    printf("\n╔════════════════════════════════════════╗\n");
-    printf("║        ACCOUNT STATUS REPORT           ║\n");
-    printf("╠════════════════════════════════════════╣\n");
-    printf("║ Account Holder: %-22s ║\n", user->name);
-    printf("╠════════════════════════════════════════╣\n");
-    printf("║ CASH                                   ║\n");
-    printf("║   Balance:           $%15.2f  ║\n", user->balance);
-    printf("║   Loan:             -$%15.2f  ║\n", user->loan);
-    printf("╠════════════════════════════════════════╣\n");
-    printf("║ ASSETS                                 ║\n");
-    printf("║   Crypto: %8.4f units  $%11.2f  ║\n", user->assets.crypto, cryptoValue);
-    printf("║   Gold:   %8.4f units  $%11.2f  ║\n", user->assets.gold, goldValue);
-    printf("║   Silver: %8.4f units  $%11.2f  ║\n", user->assets.silver, silverValue);
-    printf("║   Total Assets:         $%11.2f  ║\n", totalAssets);
-    printf("╠════════════════════════════════════════╣\n");
-    printf("║ FOREIGN EXCHANGE                       ║\n");
-    printf("║   EUR: %10.2f units  $%11.2f  ║\n", user->currencies.eur, eurValue);
-    printf("║   GBP: %10.2f units  $%11.2f  ║\n", user->currencies.gbp, gbpValue);
-    printf("║   INR: %10.2f units  $%11.2f  ║\n", user->currencies.inr, inrValue);
-    printf("║   Total Forex:          $%11.2f  ║\n", totalForex);
-    printf("╠════════════════════════════════════════╣\n");
-    printf("║ NET WORTH:              $%11.2f  ║\n", netWorth);
-    printf("╚════════════════════════════════════════╝\n");
+void printAllocationTotals(void) {
+    printf("%-16s %12s %12s %14s\n", "Subsystem", "Allocations", "Frees", "Bytes");
+    for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++) {
+        printf("%-16s %12llu %12llu %14llu\n", ALLOC_SUBSYSTEM_NAMES[s],
+               atomic_load(&allocBySubsystem[s].allocations), atomic_load(&allocBySubsystem[s].frees),
+               atomic_load(&allocBySubsystem[s].bytes));
+    }
+    printf("\n%-16s %12s %12s %14s\n", "Operation", "Allocations", "Frees", "Bytes");
+    for (int op = 0; op <= OP_INTEREST; op++) {
+        printf("%-16s %12llu %12llu %14llu\n", op == 0 ? "(none)" : METRIC_OP_LABELS[op],
+               atomic_load(&allocByOperation[op].allocations), atomic_load(&allocByOperation[op].frees),
+               atomic_load(&allocByOperation[op].bytes));
+    }
+}
+
+#ifdef BANK_ALLOC_TRACKING
+static unsigned long long allocCalls(AllocCounters *counters) {
+    return atomic_load(&counters->allocations) + atomic_load(&counters->frees);
 }
 
 /**
- * Manage foreign currency wallet
+ * Run one engine request of the given kind against a random account
  */
-void manageForexWallet(void) {
-    Account *user = &accounts[currentUserIndex];
-    
-    printf("\n=== FOREX WALLET ===\n");
-    printf("USD Balance: $%.2f\n\n", user->balance);
-    printf("EUR: %.2f (≈ $%.2f)\n", user->currencies.eur, user->currencies.eur * exchangeRates.eur);
-    printf("GBP: %.2f (≈ $%.2f)\n", user->currencies.gbp, user->currencies.gbp * exchangeRates.gbp);
-    printf("INR: %.2f (≈ $%.2f)\n\n", user->currencies.inr, user->currencies.inr * exchangeRates.inr);
-    
-    printf("1. Convert USD → EUR\n");
-    printf("2. Convert USD → GBP\n");
-    printf("3. Convert USD → INR\n");
-    printf("4. Convert Foreign Currency → USD\n");
-    printf("5. Back\n");
+static void allocCheckRun(int op, const int *assets, int assetCount, unsigned long long *seed,
+                          unsigned long long *transaction) {
+    Request request;
+    Response response;
+    memset(&request, 0, sizeof(request));
+    int index = (int)(nextRandom(seed) % (unsigned long long)accountCount);
+    request.requestId = ++*transaction;
+    request.transactionId = request.requestId;
+    request.op = op;
+    request.accountIndex = index;
+    request.pin = accounts[index].pin;
+    request.instrument = assets[nextRandom(seed) % (unsigned long long)assetCount];
+    request.amount = (float)(1 + nextRandom(seed) % 100);
+    executeRequest(&request, &response);
+}
+#endif
+
+/**
+ * Verify that deposits, withdrawals, asset purchases and saves make no
+ * allocator calls in steady state. Each runs `operations` times to warm
+ * up (journal buffers, dedupe window, checkpoints) and as many again while
+ * measured, against synthetic accounts in a scratch directory. Returns the
+ * number of operations that allocated, or -1 if the check could not run.
+ */
+int runAllocationCheck(int operations) {
+#ifndef BANK_ALLOC_TRACKING
+    (void)operations;
+    printf("\n[ERROR] Allocation checks need a build with -DBANK_ALLOC_TRACKING.\n");
+    return -1;
+#else
+    int assets[MAX_INSTRUMENTS];
+    int assetCount = 0;
+    for (int i = 0; i < instrumentCount; i++) {
+        if (instruments[i].kind == INSTRUMENT_ASSET) {
+            assets[assetCount++] = i;
+        }
+    }
     
-    int choice;
-    if (!getIntInput("\nChoice: ", &choice)) {
-        displayError(ERROR_INVALID_INPUT);
-        return;
+    char directory[] = "/tmp/bank-alloc-XXXXXX";
+    int previous = operations > 0 && assetCount > 0 ? enterScratchDirectory(directory) : -1;
+    if (previous < 0) {
+        return -1;
     }
+    if (!populateSyntheticAccounts(ALLOC_CHECK_ACCOUNTS, 1) ||
+        openJournal(SNAPSHOT_SEQUENCE_UNKNOWN) != SUCCESS) {
+        removeScratchDirectory(directory, previous);
+        return -1;
+    }
+    findAccount(""); // Build the name index before measuring
     
-    if (choice >= 1 && choice <= 3) {
-        float amount;
-        if (!getFloatInput("Enter USD amount to convert: $", &amount)) {
-            displayError(ERROR_INVALID_INPUT);
-            return;
-        }
-        
-        if (amount > user->balance) {
-            displayError(ERROR_INSUFFICIENT_FUNDS);
-            return;
-        }
-        
-        user->balance -= amount;
-        
-        switch (choice) {
-            case 1:
-                user->currencies.eur += amount / exchangeRates.eur;
-                printf("\n[SUCCESS] Converted $%.2f to %.2f EUR\n", amount, amount / exchangeRates.eur);
-                break;
-            case 2:
-                user->currencies.gbp += amount / exchangeRates.gbp;
-                printf("\n[SUCCESS] Converted $%.2f to %.2f GBP\n", amount, amount / exchangeRates.gbp);
-                break;
-            case 3:
-                user->currencies.inr += amount / exchangeRates.inr;
-                printf("\n[SUCCESS] Converted $%.2f to %.2f INR\n", amount, amount / exchangeRates.inr);
-                break;
-        }
-        
-        saveAccounts();
-    } else if (choice == 4) {
-        printf("\n1. EUR → USD\n");
-        printf("2. GBP → USD\n");
-        printf("3. INR → USD\n");
-        
-        int currencyChoice;
-        float amount;
-        
-        if (!getIntInput("Choice: ", &currencyChoice)) {
-            displayError(ERROR_INVALID_INPUT);
-            return;
-        }
-        
-        if (!getFloatInput("Enter amount to convert: ", &amount)) {
-            displayError(ERROR_INVALID_INPUT);
-            return;
+    static const int checkedOps[] = {OP_DEPOSIT, OP_WITHDRAW, OP_PURCHASE};
+    unsigned long long seed = 1;
+    unsigned long long transaction = 0;
+    int failures = 0;
+    printf("[INFO] %d accounts, %d warm-up and %d measured runs per operation in %s\n\n",
+           ALLOC_CHECK_ACCOUNTS, operations, operations, directory);
+    
+    for (size_t k = 0; k < sizeof(checkedOps) / sizeof(checkedOps[0]); k++) {
+        int op = checkedOps[k];
+        for (int i = 0; i < operations; i++) {
+            allocCheckRun(op, assets, assetCount, &seed, &transaction);
         }
-        
-        bool success = false;
-        float usdAmount = 0;
-        
-        switch (currencyChoice) {
-            case 1:
-                if (amount <= user->currencies.eur) {
-                    user->currencies.eur -= amount;
-                    usdAmount = amount * exchangeRates.eur;
-                    user->balance += usdAmount;
-                    printf("\n[SUCCESS] Converted %.2f EUR to $%.2f\n", amount, usdAmount);
-                    success = true;
-                }
-                break;
-            case 2:
-                if (amount <= user->currencies.gbp) {
-                    user->currencies.gbp -= amount;
-                    usdAmount = amount * exchangeRates.gbp;
-                    user->balance += usdAmount;
-                    printf("\n[SUCCESS] Converted %.2f GBP to $%.2f\n", amount, usdAmount);
-                    success = true;
-                }
-                break;
-            case 3:
-                if (amount <= user->currencies.inr) {
-                    user->currencies.inr -= amount;
-                    usdAmount = amount * exchangeRates.inr;
-                    user->balance += usdAmount;
-                    printf("\n[SUCCESS] Converted %.2f INR to $%.2f\n", amount, usdAmount);
-                    success = true;
-                }
-                break;
+        unsigned long long before = allocCalls(&allocByOperation[op]);
+        for (int i = 0; i < operations; i++) {
+            allocCheckRun(op, assets, assetCount, &seed, &transaction);
         }
-        
-        if (success) {
-            saveAccounts();
+        unsigned long long calls = allocCalls(&allocByOperation[op]) - before;
+        if (calls == 0) {
+            printf("[SUCCESS] %-9s no allocator calls in %d operations\n", METRIC_OP_LABELS[op], operations);
         } else {
-            displayError(ERROR_INSUFFICIENT_FUNDS);
+            printf("[ERROR] %-9s %llu allocator call(s) in %d operations\n", METRIC_OP_LABELS[op], calls, operations);
+            failures++;
         }
     }
+    
+    saveAccounts();
+    unsigned long long before = allocCalls(&allocBySubsystem[ALLOC_PERSISTENCE]);
+    for (int i = 0; i < ALLOC_CHECK_SAVES; i++) {
+        saveAccounts();
+    }
+    unsigned long long calls = allocCalls(&allocBySubsystem[ALLOC_PERSISTENCE]) - before;
+    if (calls == 0) {
+        printf("[SUCCESS] %-9s no allocator calls in %d saves\n", "save", ALLOC_CHECK_SAVES);
+    } else {
+        printf("[ERROR] %-9s %llu allocator call(s) in %d saves\n", "save", calls, ALLOC_CHECK_SAVES);
+        failures++;
+    }
+    
+    printf("\n");
+    printAllocationTotals();
+    
+    removeScratchDirectory(directory, previous);
+    return failures;
+#endif
 }
 
 // ==================== MENU SYSTEMS ====================
@@ -778,31 +6643,268 @@ void displayUserMenu(void) {
     printf("║  6. Update Market                      ║\n");
     printf("║  7. Add Interest                       ║\n");
     printf("║  8. Forex Wallet                       ║\n");
-    printf("║  9. Logout                             ║\n");
+    printf("║  9. Transaction History                ║\n");
+    printf("║ 10. Logout                             ║\n");
     printf("╚════════════════════════════════════════╝\n");
 }
 
 // ==================== MAIN PROGRAM ====================
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    // Leading options: --shared lets several processes operate on one
+    // account region, --trace FILE records a span timeline of the run,
+    // --metrics-port PORT and --metrics-file FILE export Prometheus metrics,
+    // --log FILE appends a structured operation log written off-thread,
+    // --huge-pages backs large account tables and the name index with 2MB pages
+    bool shared = false;
+    bool hugePages = false;
+    int metricsPort = 0;
+    const char *metricsFile = NULL;
+    while (argc >= 2) {
+        if (strcmp(argv[1], "--shared") == 0) {
+            shared = true;
+            argc--;
+            argv++;
+        } else if (argc >= 3 && strcmp(argv[1], "--trace") == 0) {
+            traceFilePath = argv[2];
+            atexit(writeTrace);
+            argc -= 2;
+            argv += 2;
+        } else if (strcmp(argv[1], "--huge-pages") == 0) {
+            hugePages = true;
+            hugePagesEnabled = true;
+            argc--;
+            argv++;
+        } else if (argc >= 3 && strcmp(argv[1], "--log") == 0) {
+            if (startLogger(argv[2]) != SUCCESS) {
+                printf("\n[WARNING] Could not open log file %s.\n", argv[2]);
+            }
+            argc -= 2;
+            argv += 2;
+        } else if (argc >= 3 && strcmp(argv[1], "--metrics-port") == 0) {
+            metricsPort = atoi(argv[2]);
+            argc -= 2;
+            argv += 2;
+        } else if (argc >= 3 && strcmp(argv[1], "--metrics-file") == 0) {
+            metricsFile = argv[2];
+            argc -= 2;
+            argv += 2;
+        } else {
+            break;
+        }
+    }
+    
     // Initialize system
+    TRACE_BEGIN("startup");
     srand((unsigned int)time(NULL));
+    registerDefaultInstruments();
+    TRACE_BEGIN("loadDirectQuotes");
+    loadDirectQuotes();
+    TRACE_END("loadDirectQuotes");
+    ensureAccountCapacity(INITIAL_ACCOUNT_CAPACITY);
+    
+    // Scaling sweep over synthetic state; needs neither data file nor journal,
+    // and prints nothing but its results so they can be piped to a plotter
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], "--bench") == 0) {
+        bool json = argc >= 3 && strcmp(argv[argc - 1], "json") == 0;
+        int maxAccounts = argc >= 3 && isdigit((unsigned char)argv[2][0]) ? atoi(argv[2]) : BENCH_DEFAULT_MAX_ACCOUNTS;
+        ErrorCode result = runBenchmarks(maxAccounts, json);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    // Allocation audit of the hot operations; runs in its own scratch directory
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--alloc-check") == 0) {
+        int failures = runAllocationCheck(argc == 3 ? atoi(argv[2]) : ALLOC_CHECK_DEFAULT_OPERATIONS);
+        if (failures < 0) {
+            displayError(ERROR_INVALID_INPUT);
+        }
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
     printf("╔════════════════════════════════════════╗\n");
     printf("║    PROFESSIONAL BANKING SYSTEM v2.0    ║\n");
     printf("╚════════════════════════════════════════╝\n");
     
-    // Load existing accounts
-    ErrorCode loadResult = loadAccounts();
-    if (loadResult == ERROR_FILE_IO) {
-        printf("\n[WARNING] Failed to load account data.\n");
-    } else {
+    // Compare two data files without touching live state
+    if (argc == 4 && strcmp(argv[1], "--diff") == 0) {
+        int differences = diffStateFiles(argv[2], argv[3]);
+        if (differences < 0) {
+            displayError(ERROR_FILE_IO);
+            return EXIT_FAILURE;
+        }
+        printf("[INFO] %d differing account(s).\n", differences);
+        return differences == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // Synthetic data for benchmarks; neither touches the live data file
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--generate-accounts") == 0) {
+        ErrorCode result = generateAccounts(atoi(argv[2]), argv[3],
+                                            argc == 5 ? strtoull(argv[4], NULL, 10) : 1);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc >= 5 && argc <= 8 && strcmp(argv[1], "--generate-workload") == 0) {
+        ErrorCode result = generateWorkload(argv[2], atol(argv[3]), argv[4],
+                                            argc >= 6 ? argv[5] : DEFAULT_WORKLOAD_MIX,
+                                            argc >= 7 ? atof(argv[6]) : DEFAULT_WORKLOAD_SKEW,
+                                            argc == 8 ? strtoull(argv[7], NULL, 10) : 1);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    // Clients of a running daemon; they own no state of their own
+    if (argc == 2 && strcmp(argv[1], "--client") == 0) {
+        return runDaemonClient() == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 2 && strcmp(argv[1], "--daemon-stats") == 0) {
+        if (printDaemonStats() != SUCCESS) {
+            printf("\n[ERROR] No daemon is running.\n");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc == 3 && strcmp(argv[1], "--client-batch") == 0) {
+        ErrorCode result = runClientBatchFile(argv[2]);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    // Hot standby: tail a primary's journal until promoted
+    bool promoted = false;
+    if (argc >= 2 && strcmp(argv[1], "--follow") == 0) {
+        promoted = runFollower(argc >= 3 ? argv[2] : ".");
+        if (!promoted) {
+            return EXIT_SUCCESS;
+        }
+        printf("\n[INFO] Promoted to primary with %d account(s).\n", accountCount);
+    }
+    
+    // Map the shared region; only its creator loads from disk
+    bool loadFromDisk = !promoted;
+    if (shared && !promoted) {
+        sharedStoreRecovery = recoverSharedStore;
+        ErrorCode sharedResult = attachSharedStore(&loadFromDisk);
+        if (sharedResult != SUCCESS) {
+            printf("\n[ERROR] Could not attach shared account store %s.\n", SHARED_STORE_NAME);
+            return EXIT_FAILURE;
+        }
+        if (!loadFromDisk) {
+            printf("\n[INFO] Attached to shared store with %d account(s).\n", accountCount);
+        }
+    }
+    
+    // Load existing accounts (a promoted follower already holds them)
+    if (loadFromDisk) {
+        // Starting from a partial table would checkpoint and overwrite it
+        ErrorCode loadResult = loadAccounts();
+        if (loadResult != SUCCESS) {
+            printf("\n[ERROR] Could not read %s; refusing to start so it is not overwritten.\n", DATA_FILE);
+            return EXIT_FAILURE;
+        }
         printf("\n[INFO] Loaded %d existing account(s).\n", accountCount);
+        if (snapshotSequence == SNAPSHOT_SEQUENCE_UNKNOWN && accountCount > 0) {
+            printf("[INFO] %s is in an older layout; it will be rewritten in the current one on save.\n", DATA_FILE);
+        }
+    }
+    
+    // Only state read from the data file can be behind the journal
+    if (openJournal(loadFromDisk ? snapshotSequence : SNAPSHOT_SEQUENCE_UNKNOWN) != SUCCESS) {
+        printf("\n[WARNING] Event journal unavailable; history will not be recorded.\n");
+    }
+    if (shared && loadFromDisk) {
+        publishSharedStore();
+    }
+    if (hugePages) {
+        findAccount(""); // Build the name index now so its backing is settled
+        reportPageBacking();
+    }
+    TRACE_END("startup");
+    
+    if ((metricsPort > 0 || metricsFile != NULL) && startMetricsExporter(metricsPort, metricsFile) != SUCCESS) {
+        printf("\n[WARNING] Metrics exporter could not start on port %d.\n", metricsPort);
+    }
+    
+    // Daemon and its ring client
+    if (argc == 2 && strcmp(argv[1], "--daemon") == 0) {
+        return runDaemon() == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // Simulated clients against the daemon or this process's own engine
+    if (argc >= 5 && argc <= 8 && strcmp(argv[1], "--load") == 0) {
+        bool viaDaemon = strcmp(argv[2], "daemon") == 0;
+        if (!viaDaemon && strcmp(argv[2], "engine") != 0) {
+            displayError(ERROR_INVALID_INPUT);
+            return EXIT_FAILURE;
+        }
+        ErrorCode result = runLoadTest(viaDaemon, atoi(argv[3]), atoi(argv[4]),
+                                       argc >= 6 ? atof(argv[5]) : 0.0,
+                                       argc >= 7 ? argv[6] : DEFAULT_LOAD_MIX,
+                                       argc == 8 ? atof(argv[7]) : DEFAULT_WORKLOAD_SKEW);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    // Memory held by each subsystem once the data file and journal are loaded
+    if (argc == 2 && strcmp(argv[1], "--memory") == 0) {
+        findAccount(""); // Include the name index a running server would build
+        printMemoryUsage();
+        return EXIT_SUCCESS;
+    }
+    
+    // Non-interactive batch modes
+    if (argc >= 2 && strcmp(argv[1], "--reconcile") == 0) {
+        int threads = argc >= 3 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int mismatches = reconcileLedger(threads);
+        if (mismatches < 0) {
+            displayError(ERROR_FILE_IO);
+            return EXIT_FAILURE;
+        }
+        printf("[INFO] Reconciliation found %d mismatch(es).\n", mismatches);
+        return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    if (argc == 3 && strcmp(argv[1], "--replay-at") == 0) {
+        ErrorCode result = reconstructStateAt((long long)(strtod(argv[2], NULL) * 1e6));
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        printf("\n=== STATE AS OF %s ===\n", argv[2]);
+        for (int i = 0; i < accountCount; i++) {
+            printAccountSummary(i);
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    if (argc == 3 && strcmp(argv[1], "--fx-batch") == 0) {
+        ErrorCode result = runFxBatchFile(argv[2]);
+        if (result != SUCCESS) {
+            displayError(result);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
     }
     
     // Main menu loop (pre-login)
     int choice;
     while (true) {
+        syncStoreView();
         displayMainMenu();
         
         if (!getIntInput("Choice: ", &choice)) {
@@ -830,6 +6932,7 @@ int main(void) {
     // User menu loop (post-login)
 user_menu:
     while (true) {
+        syncStoreView();
         displayUserMenu();
         
         if (!getIntInput("Choice: ", &choice)) {
@@ -863,6 +6966,9 @@ user_menu:
                 manageForexWallet();
                 break;
             case 9:
+                displayTransactionHistory();
+                break;
+            case 10:
                 printf("\n[INFO] Logging out... Goodbye, %s!\n", accounts[currentUserIndex].name);
                 currentUserIndex = -1;
                 return EXIT_SUCCESS;